@@ -10,14 +10,22 @@ set(PROJECT_SOURCE_FILES
     "${PROJECT_SRC_DIR}/utility/utility.cpp"
     "${PROJECT_SRC_DIR}/utility/restservice.cpp"
     "${PROJECT_SRC_DIR}/utility/scopeguard.cpp"
+    "${PROJECT_SRC_DIR}/utility/mappedfile.cpp"
+    "${PROJECT_SRC_DIR}/utility/spatialgrid.cpp"
+    "${PROJECT_SRC_DIR}/utility/workerpool.cpp"
     "${PROJECT_SRC_DIR}/utility/configuration.cpp"
     "${PROJECT_SRC_DIR}/utility/exceptions.cpp"
     "${PROJECT_SRC_DIR}/analysis/simplecoincidence.cpp"
     "${PROJECT_SRC_DIR}/analysis/coincidence.cpp"
     "${PROJECT_SRC_DIR}/analysis/eventconstructor.cpp"
+    "${PROJECT_SRC_DIR}/analysis/coincidenceengine.cpp"
     "${PROJECT_SRC_DIR}/analysis/coincidencefilter.cpp"
+    "${PROJECT_SRC_DIR}/analysis/watermark.cpp"
+    "${PROJECT_SRC_DIR}/analysis/quantile.cpp"
+    "${PROJECT_SRC_DIR}/analysis/detectortable.cpp"
     "${PROJECT_SRC_DIR}/analysis/detectorstation.cpp"
     "${PROJECT_SRC_DIR}/analysis/stationcoincidence.cpp"
+    "${PROJECT_SRC_DIR}/analysis/histogramarchive.cpp"
     "${PROJECT_SRC_DIR}/supervision/state.cpp"
     "${PROJECT_SRC_DIR}/supervision/timebase.cpp"
     "${PROJECT_SRC_DIR}/supervision/resource.cpp"
@@ -49,6 +57,11 @@ set(PROJECT_HEADER_FILES
     "${PROJECT_HEADER_DIR}/utility/restservice.h"
     "${PROJECT_HEADER_DIR}/utility/base64.h"
     "${PROJECT_HEADER_DIR}/utility/scopeguard.h"
+    "${PROJECT_HEADER_DIR}/utility/deadlinequeue.h"
+    "${PROJECT_HEADER_DIR}/utility/binarystream.h"
+    "${PROJECT_HEADER_DIR}/utility/mappedfile.h"
+    "${PROJECT_HEADER_DIR}/utility/spatialgrid.h"
+    "${PROJECT_HEADER_DIR}/utility/workerpool.h"
     "${PROJECT_HEADER_DIR}/utility/exceptions.h"
     "${PROJECT_HEADER_DIR}/utility/coordinatemodel.h"
     "${PROJECT_HEADER_DIR}/utility/units.h"
@@ -57,14 +70,21 @@ set(PROJECT_HEADER_FILES
     "${PROJECT_HEADER_DIR}/analysis/cachedvalue.h"
     "${PROJECT_HEADER_DIR}/analysis/ratemeasurement.h"
     "${PROJECT_HEADER_DIR}/analysis/histogram.h"
+    "${PROJECT_HEADER_DIR}/analysis/sparsehistogram.h"
     "${PROJECT_HEADER_DIR}/analysis/simplecoincidence.h"
     "${PROJECT_HEADER_DIR}/analysis/coincidence.h"
     "${PROJECT_HEADER_DIR}/analysis/criterion.h"
     "${PROJECT_HEADER_DIR}/analysis/uppermatrix.h"
     "${PROJECT_HEADER_DIR}/analysis/eventconstructor.h"
+    "${PROJECT_HEADER_DIR}/analysis/coincidenceengine.h"
     "${PROJECT_HEADER_DIR}/analysis/coincidencefilter.h"
+    "${PROJECT_HEADER_DIR}/analysis/sweepfilter.h"
+    "${PROJECT_HEADER_DIR}/analysis/watermark.h"
+    "${PROJECT_HEADER_DIR}/analysis/quantile.h"
+    "${PROJECT_HEADER_DIR}/analysis/detectortable.h"
     "${PROJECT_HEADER_DIR}/analysis/detectorstation.h"
     "${PROJECT_HEADER_DIR}/analysis/stationcoincidence.h"
+    "${PROJECT_HEADER_DIR}/analysis/histogramarchive.h"
     "${PROJECT_HEADER_DIR}/supervision/state.h"
     "${PROJECT_HEADER_DIR}/supervision/timebase.h"
     "${PROJECT_HEADER_DIR}/supervision/resource.h"
@@ -3,29 +3,74 @@
 
 #include "analysis/criterion.h"
 
+#include "utility/coordinatemodel.h"
 #include "utility/units.h"
 
 #include "messages/event.h"
 
 #include <chrono>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace muonpi {
 
 /**
  * @brief The Coincidence class
  * Defines the parameters for a coincidence between two events
+ * The ECEF position of every station is kept in an immutable snapshot, which is never changed once published.
+ * The snapshot is replaced as a whole when a station moves or is removed, so the memory only grows linearly with the number of stations.
+ * Loading the current snapshot synchronises with the writers, so callers matching many events at once take it once
+ * with snapshot() and pass it to apply.
  */
-class coincidence : public criterion {
+class coincidence final : public criterion {
 public:
+    using geometry_t = std::unordered_map<std::uint64_t, coordinate::ecef<double>>; //< the ECEF position of every known station
+    using snapshot_t = std::shared_ptr<const geometry_t>;
+
+    coincidence();
     ~coincidence() override;
     /**
      * @brief criterion Assigns a value of type T to a pair of events
-     * @param first The first event to check
-     * @param second the second event to check
+     * @param first The constituents of the first event to check
+     * @param second The constituents of the second event to check
+     * @return true if the events have a coincidence
+     */
+    [[nodiscard]] auto apply(const constituents& first, const constituents& second) const -> double override;
+
+    /**
+     * @brief apply Assigns a value to a pair of events using a geometry snapshot taken before
+     * @param geometry The snapshot to use, @see snapshot
+     * @param first The constituents of the first event to check
+     * @param second The constituents of the second event to check
      * @return true if the events have a coincidence
      */
-    [[nodiscard]] auto apply(const event_t& first, const event_t& second) const -> double override;
+    [[nodiscard]] auto apply(const snapshot_t& geometry, const constituents& first, const constituents& second) const -> double;
+
+    /**
+     * @brief snapshot Gets the current geometry. It stays valid and unchanged while the geometry is updated.
+     * @return The snapshot
+     */
+    [[nodiscard]] auto snapshot() const -> snapshot_t;
+
+    /**
+     * @brief window
+     * @return The largest time difference in ns between two constituents for which the criterion can still be true.
+     */
+    [[nodiscard]] auto window() const -> std::int_fast64_t override
+    {
+        return static_cast<std::int_fast64_t>(s_maximum_time) + 1;
+    }
+
+    /**
+     * @brief maximum_distance
+     * @return The largest distance in meter between two stations for which the criterion can still be true.
+     */
+    [[nodiscard]] auto maximum_distance() const -> double override
+    {
+        return s_maximum_distance;
+    }
 
     /**
      * @brief maximum_false
@@ -45,17 +90,50 @@ public:
         return 0.0;
     }
 
+    /**
+     * @brief set_location Updates the position of a station in the geometry.
+     * A new snapshot is only published if the station is new or moved by more than s_location_tolerance.
+     * @param hash The hash of the station
+     * @param location The new location of the station
+     */
+    void set_location(std::uint64_t hash, const location_t& location) override;
+
+    /**
+     * @brief remove Removes a station from the geometry
+     * @param hash The hash of the station
+     */
+    void remove(std::uint64_t hash) override;
+
 private:
     /**
      * @brief compare Compare two timestamps to each other
+     * @param geometry The geometry snapshot to use
      * @param difference difference between both timestamps
      * @return returns a value indicating the coincidence time between the two timestamps. @see maximum_false @see minimum_true for the limits of the values.
      */
-    [[nodiscard]] static auto compare(const event_t::data_t& first, const event_t::data_t& second) -> double;
+    [[nodiscard]] auto compare(const geometry_t& geometry, const event_t::data_t& first, const event_t::data_t& second) const -> double;
+
+    /**
+     * @brief position Gets the position of a station.
+     * Stations which are not in the geometry yet, for example ones restored from a checkpoint which did not send a location since, are converted on the fly.
+     * @param geometry The geometry snapshot to use
+     * @param data The data of the station
+     * @return The ECEF position of the station
+     */
+    [[nodiscard]] static auto position(const geometry_t& geometry, const event_t::data_t& data) -> coordinate::ecef<double>;
+
+    /**
+     * @brief to_ecef Converts a location to ECEF coordinates
+     */
+    [[nodiscard]] static auto to_ecef(const location_t& location) -> coordinate::ecef<double>;
 
     constexpr static double s_maximum_distance { 100 * units::kilometer };
     constexpr static double s_maximum_time { s_maximum_distance / consts::c_0 };
     constexpr static double s_minimum_time { 50.0 * units::nanosecond };
+    constexpr static double s_location_tolerance { 1.0 * units::meter }; //< smaller changes of a station position do not publish a new snapshot
+
+    std::mutex m_mutex {}; //< serialises the writers, readers only use the snapshot
+    std::shared_ptr<const geometry_t> m_geometry { nullptr }; //< only accessed with std::atomic_load and std::atomic_store
 };
 
 }
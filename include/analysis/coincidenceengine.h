@@ -0,0 +1,137 @@
+#ifndef COINCIDENCEENGINE_H
+#define COINCIDENCEENGINE_H
+
+#include "analysis/criterion.h"
+#include "analysis/watermark.h"
+#include "messages/detectorinfo.h"
+#include "messages/event.h"
+#include "messages/trigger.h"
+#include "sink/base.h"
+#include "source/base.h"
+#include "supervision/state.h"
+#include "supervision/timebase.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+
+namespace muonpi {
+
+/**
+ * @brief The coincidence_engine class
+ * Common base of all engines which combine incoming events into coincidences.
+ * It receives events and the timebase and sends the finished coincidences to the event sink.
+ * The station locations and removals are passed on to the criterion, so it never has to update its data while matching.
+ */
+class coincidence_engine : public sink::threaded<event_t>, public source::base<event_t>, public sink::base<timebase_t>, public sink::base<detector_info_t<location_t>>, public sink::base<trigger::detector> {
+public:
+    /**
+     * @brief coincidence_engine
+     * @param event_sink A collection of event sinks to use
+     * @param supervisor A reference to a state_supervisor, which keeps track of program metadata
+     */
+    coincidence_engine(sink::base<event_t>& event_sink, supervision::state& supervisor);
+
+    ~coincidence_engine() override = default;
+
+    /**
+     * @brief get Get one timebase_t object. Reimplemented from sink::base
+     * @param timebase
+     */
+    void get(timebase_t timebase) override;
+
+    /**
+     * @brief get Get one event_t object. Reimplemented from sink::base
+     * @param event
+     */
+    void get(event_t event) override;
+
+    /**
+     * @brief get Get the location of a detector. Reimplemented from sink::base
+     * @param detector_info
+     */
+    void get(detector_info_t<location_t> detector_info) override;
+
+    /**
+     * @brief get Get a status change of a detector. Deleted detectors are removed from the criterion. Reimplemented from sink::base
+     * @param trigger
+     */
+    void get(trigger::detector trigger) override;
+
+protected:
+    /**
+     * @brief used_criterion The criterion instance of the engine
+     */
+    [[nodiscard]] virtual auto used_criterion() -> criterion& = 0;
+
+    /**
+     * @brief shares_station Checks whether two events contain an event from the same station. Those can never be coincident.
+     * @param first The first event
+     * @param second The second event
+     * @return true if both events share at least one station
+     */
+    [[nodiscard]] static auto shares_station(const event_t& first, const event_t& second) -> bool;
+
+    /**
+     * @brief station_mask A one word bloom filter of the stations in an event, with one bit per station.
+     * If the masks of two events do not intersect, the events share no station. If they do, shares_station has to decide.
+     * @param event The event
+     * @return The mask
+     */
+    [[nodiscard]] static auto station_mask(const event_t& event) -> std::uint64_t;
+
+    /**
+     * @brief combine Adds all constituents of an event to a coincidence
+     * @param target The coincidence to extend. If it is a single event, it is converted into a coincidence first.
+     * @param other The event to add
+     */
+    static void combine(event_t& target, event_t other);
+
+    /**
+     * @brief observe Records the arrival of an event for the watermark. Events which arrive behind the watermark are counted as late.
+     * @param event The event which arrived
+     */
+    void observe(const event_t& event);
+
+    /**
+     * @brief advance Moves the watermark to the current time. Never further back than the timeout.
+     */
+    void advance();
+
+    supervision::state& m_supervisor;
+
+    std::chrono::system_clock::duration m_timeout { std::chrono::seconds { 10 } }; //< how long to wait for further events of a coincidence
+
+    watermark m_watermark {};
+};
+
+// +++++++++++++++++++++++++++++++
+// implementation part starts here
+// +++++++++++++++++++++++++++++++
+
+inline auto coincidence_engine::shares_station(const event_t& first, const event_t& second) -> bool
+{
+    if ((first.events.size() < 2) && (second.events.size() < 2)) {
+        return first.data.hash == second.data.hash;
+    }
+    const constituents lhs { first };
+    const constituents rhs { second };
+    return std::any_of(lhs.begin(), lhs.end(), [&](const event_t::data_t& l) {
+        return std::any_of(rhs.begin(), rhs.end(), [&](const event_t::data_t& r) { return l.hash == r.hash; });
+    });
+}
+
+inline auto coincidence_engine::station_mask(const event_t& event) -> std::uint64_t
+{
+    // fibonacci hashing, so the bit is taken from all bits of the station hash
+    constexpr std::uint64_t multiplier { 0x9e3779b97f4a7c15 };
+    std::uint64_t mask { 0 };
+    for (const auto& data : constituents { event }) {
+        mask |= std::uint64_t { 1 } << ((data.hash * multiplier) >> 58U);
+    }
+    return mask;
+}
+
+}
+
+#endif // COINCIDENCEENGINE_H
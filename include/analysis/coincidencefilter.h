@@ -2,47 +2,309 @@
 #define COINCIDENCEFILTER_H
 
 #include "analysis/coincidence.h"
+#include "analysis/coincidenceengine.h"
 #include "analysis/detectorstation.h"
 #include "analysis/eventconstructor.h"
 #include "analysis/simplecoincidence.h"
 #include "messages/clusterlog.h"
 #include "supervision/state.h"
 #include "supervision/timebase.h"
+#include "utility/mappedfile.h"
+#include "utility/spatialgrid.h"
 #include "utility/threadrunner.h"
+#include "utility/workerpool.h"
 
+#include <limits>
 #include <map>
-#include <queue>
+#include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace muonpi {
 
 /**
- * @brief The coincidence_filter class
+ * @brief The coincidence_filter_base class
+ * Holds the open event constructors and everything which does not depend on the criterion.
+ * The matching itself is done by coincidence_filter, which knows the criterion at compile time.
+ *
+ * The constructors are kept in slots which are reused through a free list, so no constructor is ever erased from the middle.
+ * Contested constructors are joined as disjoint sets: the absorbed constructors stay in their slots and are only linked to the set,
+ * their constituents are moved into the root once it is matched against again, sent off or written to a checkpoint.
+ *
+ * If the criterion has a maximum distance, every constructor is also registered in the grid cells of its stations.
+ * A new event is then only matched against the constructors in the cells within reach of its own stations.
+ *
+ * With more than one thread, incoming events are collected in a batch instead, each with the finishing threshold in effect at its arrival.
+ * The batch is cut into components: groups of events and open constructors whose time windows overlap, widened by the criterion window.
+ * No event can match anything outside its component, so the components are matched in parallel, each in the order of arrival.
+ * A constructor is only a candidate for an event if it would not have been finished before the event arrived,
+ * so the result is the same as with a single thread. Only the timeout fallback is checked once the batch is matched, not at every arrival.
  */
-class coincidence_filter : public sink::threaded<event_t>, public source::base<event_t>, public sink::base<timebase_t> {
+class coincidence_filter_base : public coincidence_engine {
 public:
     /**
-     * @brief coincidence_filter
+     * @brief coincidence_filter_base
      * @param event_sink A collection of event sinks to use
      * @param supervisor A reference to a state_supervisor, which keeps track of program metadata
+     * @param threads The number of threads to use for matching
      */
-    coincidence_filter(sink::base<event_t>& event_sink, supervision::state& supervisor);
+    coincidence_filter_base(sink::base<event_t>& event_sink, supervision::state& supervisor, std::size_t threads);
 
-    ~coincidence_filter() override = default;
+    ~coincidence_filter_base() override = default;
+
+protected:
+    /**
+     * @brief process gets periodically called by sink::threaded
+     * @return
+     */
+    [[nodiscard]] auto process() -> int override;
+
+    /**
+     * @brief post_run Reimplemented from thread_runner. Writes a final checkpoint of the open constructors.
+     */
+    [[nodiscard]] auto post_run() -> int override;
+
+    /**
+     * @brief The batched_t struct. An event waiting in the batch.
+     */
+    struct batched_t {
+        event_t event {};
+        std::int64_t finished {}; //< constructors whose last constituent is before this were finished when the event arrived
+    };
+
+    /**
+     * @brief The component_t struct. Events of one batch and the open constructors they can reach, matched independently of all others.
+     */
+    struct component_t {
+        std::vector<batched_t> events {}; //< in the order of arrival
+        std::vector<event_constructor> open {};
+    };
+
+    /**
+     * @brief enqueue Adds a new event to the batch
+     * @param event The new event
+     */
+    void enqueue(event_t event);
+
+    /**
+     * @brief run Matches the events of all components of a batch
+     * @param components The components, the open constructors of every component get updated
+     */
+    virtual void run(std::vector<component_t>& components) = 0;
+
+    /**
+     * @brief merge Adds an event to the constructors it matched
+     * @param event The new event
+     * @param matches The slots of all constructors the event matched
+     */
+    void merge(event_t event, const std::vector<std::size_t>& matches);
 
     /**
-     * @brief get Get one timebase_t object. Reimplemented from sink::base
-     * @param timebase
+     * @brief consolidate Moves the constituents of all constructors joined to a set into its root and frees their slots
+     * @param root The slot of the root constructor
      */
-    void get(timebase_t timebase) override;
+    void consolidate(std::size_t root);
 
     /**
-     * @brief get Get one event_t object. Reimplemented from sink::base
-     * @param event
+     * @brief pending
+     * @param root The slot of a root constructor
+     * @return true if other constructors were joined to the set and not yet consolidated
      */
-    void get(event_t event) override;
+    [[nodiscard]] auto pending(std::size_t root) const -> bool;
+
+    /**
+     * @brief open_constructors
+     * @return The number of constructors in use, including the ones joined to another set
+     */
+    [[nodiscard]] auto open_constructors() const -> std::size_t;
+
+    /**
+     * @brief select Collects the candidates for a new event in m_candidates.
+     * These are all root constructors whose time window overlaps the given interval and, if a maximum distance is set,
+     * which have a station in a cell within reach of the event.
+     * @param event The new event
+     * @param lower The lower end of the interval in ns
+     * @param upper The upper end of the interval in ns
+     */
+    void select(const event_t& event, std::int64_t lower, std::int64_t upper);
+
+    /**
+     * @brief set_maximum_distance Restricts the candidates to constructors within a distance. Has to be called before the first event.
+     * @param distance The distance in meter. If it is not finite, the location is not used.
+     */
+    void set_maximum_distance(double distance);
+
+    /**
+     * @brief window
+     * @return The criterion window in ns. A constructor is finished once the watermark has passed its last constituent by this much.
+     */
+    [[nodiscard]] virtual auto window() const -> std::int64_t = 0;
+
+    std::unique_ptr<worker_pool> m_pool { nullptr }; //< only set with more than one thread
+    std::vector<event_constructor> m_constructors {}; //< constructor slots, free slots hold an empty constructor
+    std::vector<std::size_t> m_candidates {}; //< result of the last select, in ascending order
+    std::vector<std::uint64_t> m_stations {}; //< station_mask of every slot, a root includes its whole set
+
+private:
+    /**
+     * @brief match_batch Cuts the batch into components, matches them and puts the resulting constructors back into slots
+     */
+    void match_batch();
+
+    /**
+     * @brief components Cuts the batch into components and moves the constructors they can reach out of their slots
+     * @return The components, in the order of their time windows
+     */
+    [[nodiscard]] auto components() -> std::vector<component_t>;
+
+    /**
+     * @brief checkpoint Appends the constructors which changed since the last checkpoint to the checkpoint file.
+     * Once the appended records outgrow the last full snapshot, a new snapshot of all open constructors replaces them.
+     */
+    void checkpoint();
+
+    /**
+     * @brief touch Marks a slot to be written with the next checkpoint
+     * @param index The slot which changed
+     */
+    void touch(std::size_t index);
+
+    /**
+     * @brief write_record Writes the current state of a slot as one checkpoint record. Joined slots are consolidated into their root first.
+     * @param out The writer to use
+     * @param index The slot to write
+     */
+    void write_record(binary_writer& out, std::size_t index);
+
+    /**
+     * @brief recover Restores the constructors from the checkpoint file and merges them with the currently open ones
+     */
+    void recover();
+
+    /**
+     * @brief add Puts a constructor into a free slot, or appends a new slot if there is none
+     * @param constructor The constructor to add
+     */
+    void add(event_constructor constructor);
+
+    /**
+     * @brief release Frees a slot and hides its time window from the prefilter
+     * @param index The slot to free
+     */
+    void release(std::size_t index);
+
+    /**
+     * @brief unite Joins the set of another root constructor to a root. Does not touch the constituents.
+     * @param root The slot of the root which is kept
+     * @param other The slot of the root which is joined
+     */
+    void unite(std::size_t root, std::size_t other);
+
+    /**
+     * @brief update_window Reads the time window of a root again after its event changed, keeping the windows of joined constructors
+     * @param index The slot of the root
+     */
+    void update_window(std::size_t index);
+
+    /**
+     * @brief is_root
+     * @param index The slot to check
+     * @return true if the slot holds a constructor which was not joined to another one
+     */
+    [[nodiscard]] auto is_root(std::size_t index) const -> bool;
+
+    /**
+     * @brief find Gets the root of the set a slot belongs to, and shortens the path on the way
+     * @param index The slot
+     * @return The slot of the root
+     */
+    [[nodiscard]] auto find(std::size_t index) -> std::size_t;
+
+    /**
+     * @brief prefilter Marks all slots whose time window overlaps the given interval in m_overlaps
+     * @param lower The lower end of the interval in ns
+     * @param upper The upper end of the interval in ns
+     */
+    void prefilter(std::int64_t lower, std::int64_t upper);
+
+    /**
+     * @brief locate Registers a slot in the grid cells of the stations of an event. Does nothing without a maximum distance.
+     * @param index The slot
+     * @param event The event whose stations to use
+     */
+    void locate(std::size_t index, const event_t& event);
+
+    /**
+     * @brief reachable Gets the cells within the maximum distance of a cell. Calculated once per cell.
+     * @param cell The cell
+     * @return The keys of the cells
+     */
+    [[nodiscard]] auto reachable(std::int64_t cell) -> const std::vector<std::int64_t>&;
+
+    static constexpr std::uint32_t s_checkpoint_magic { 0x4a43434d };
+    static constexpr std::chrono::system_clock::duration s_checkpoint_interval { std::chrono::seconds { 1 } };
+    static constexpr std::size_t s_compaction_factor { 4 }; //< the records may grow to this multiple of the last snapshot before a new one is written
+    static constexpr std::size_t s_minimum_snapshot { 1 << 20 }; //< snapshot size in bytes assumed for the compaction, so small checkpoints are not rewritten too often
+    static constexpr std::uint8_t s_record_free { 0 };
+    static constexpr std::uint8_t s_record_store { 1 };
+
+    static constexpr std::size_t s_free { std::numeric_limits<std::size_t>::max() }; //< parent of a free slot
+    static constexpr std::size_t s_maximum_batch { 1 << 14 }; //< number of events after which a batch is matched at the latest
+
+    std::vector<batched_t> m_batch {}; //< events waiting to be matched, in the order of arrival
+    std::int64_t m_batch_last { std::numeric_limits<std::int64_t>::min() }; //< latest constituent of all events in the batch
+    std::int64_t m_finished { std::numeric_limits<std::int64_t>::min() }; //< finishing threshold of the last call to process
+
+    // time window of every slot, parallel to m_constructors, so the prefilter does not need to touch the events
+    // free and joined slots get an empty window, a root gets the window of its whole set
+    std::vector<std::int64_t> m_starts {}; //< earliest start of the constituents in ns
+    std::vector<std::int64_t> m_ends {}; //< latest start of the constituents in ns
+
+    std::vector<std::size_t> m_parents {}; //< the slot a constructor was joined to, the slot itself for a root or s_free
+    std::vector<std::size_t> m_next {}; //< circular list through all slots of a set, used to consolidate it
+    std::vector<std::size_t> m_free {}; //< free slots
+    std::vector<std::uint8_t> m_overlaps {}; //< result of the last prefilter, one entry per slot
+
+    // spatial index, only used if the criterion has a maximum distance
+    // bucket entries of freed slots are recognised by their generation and dropped lazily
+    std::unique_ptr<spatial_grid> m_grid { nullptr };
+    std::unordered_map<std::int64_t, std::vector<std::int64_t>> m_reachable {}; //< neighbour cells of every cell seen so far
+    std::unordered_map<std::int64_t, std::vector<std::pair<std::size_t, std::uint32_t>>> m_buckets {}; //< slot and generation of all slots with a station in a cell
+    std::vector<std::vector<std::int64_t>> m_cells {}; //< cells every slot is registered in
+    std::vector<std::uint32_t> m_generations {}; //< incremented every time a slot is freed
+
+    // the checkpoint file holds a snapshot followed by records of the slots which changed since, the last record of a slot wins
+    std::unique_ptr<mapped_file> m_checkpoint { nullptr };
+    std::vector<std::uint8_t> m_touched {}; //< whether a slot is in m_changes
+    std::vector<std::size_t> m_changes {}; //< slots changed since the last checkpoint
+    std::size_t m_snapshot_size { 0 };
+    bool m_snapshot_due { true };
+    bool m_recovered { false };
+    std::chrono::system_clock::time_point m_last_checkpoint { std::chrono::system_clock::now() };
+};
+
+/**
+ * @brief The coincidence_filter class
+ * The criterion is a template parameter, so it is called without virtual dispatch and can be inlined into the matching loop.
+ * @param Criterion The criterion to use. Needs to be default constructible and derived from criterion.
+ */
+template <typename Criterion>
+class coincidence_filter : public coincidence_filter_base {
+public:
+    /**
+     * @brief coincidence_filter
+     * @param event_sink A collection of event sinks to use
+     * @param supervisor A reference to a state_supervisor, which keeps track of program metadata
+     * @param threads The number of threads to use for matching
+     */
+    coincidence_filter(sink::base<event_t>& event_sink, supervision::state& supervisor, std::size_t threads = 1);
+
+    ~coincidence_filter() override = default;
 
 protected:
+    using coincidence_filter_base::process;
+
     /**
      * @brief process Called from step(). Handles a new event arriving
      * @param event The event to process
@@ -50,21 +312,144 @@ protected:
     [[nodiscard]] auto process(event_t event) -> int override;
 
     /**
-     * @brief process gets periodically called by sink::threaded
-     * @return
+     * @brief run Reimplemented from coincidence_filter_base
      */
-    [[nodiscard]] auto process() -> int override;
+    void run(std::vector<component_t>& components) override;
 
-private:
-    std::unique_ptr<criterion> m_criterion { std::make_unique<simple_coincidence>() };
+    /**
+     * @brief window Reimplemented from coincidence_filter_base
+     */
+    [[nodiscard]] auto window() const -> std::int64_t override;
+
+    /**
+     * @brief used_criterion Reimplemented from coincidence_engine
+     */
+    [[nodiscard]] auto used_criterion() -> criterion& override;
 
-    std::vector<event_constructor> m_constructors {};
+private:
+    using snapshot_t = typename Criterion::snapshot_t;
 
-    std::chrono::system_clock::duration m_timeout { std::chrono::seconds { 10 } };
+    /**
+     * @brief match Matches the events of one component in the order of their arrival
+     * @param snapshot The snapshot of the criterion taken for this batch
+     * @param component The component to match
+     */
+    void match(const snapshot_t& snapshot, component_t& component) const;
 
-    supervision::state& m_supervisor;
+    Criterion m_criterion {};
 };
 
+// +++++++++++++++++++++++++++++++
+// implementation part starts here
+// +++++++++++++++++++++++++++++++
+
+template <typename Criterion>
+coincidence_filter<Criterion>::coincidence_filter(sink::base<event_t>& event_sink, supervision::state& supervisor, std::size_t threads)
+    : coincidence_filter_base { event_sink, supervisor, threads }
+{
+    set_maximum_distance(m_criterion.maximum_distance());
+}
+
+template <typename Criterion>
+auto coincidence_filter<Criterion>::process(event_t event) -> int
+{
+    m_supervisor.increase_event_count(true);
+    observe(event);
+
+    if (m_pool != nullptr) {
+        enqueue(std::move(event));
+        return 0;
+    }
+
+    const constituents incoming { event };
+    const std::uint64_t stations { station_mask(event) };
+    const double maximum_false { m_criterion.maximum_false() };
+    const std::int64_t window { m_criterion.window() };
+
+    select(event, incoming.start() - window, incoming.last() + window);
+
+    // one snapshot for all candidates, so the criterion is not synchronised for every comparison
+    const auto snapshot { m_criterion.snapshot() };
+    std::vector<std::size_t> matches {};
+    for (const std::size_t i : m_candidates) {
+        if (pending(i)) {
+            consolidate(i);
+        }
+        const event_t& candidate { m_constructors[i].event };
+        if (((m_stations[i] & stations) != 0) && shares_station(event, candidate)) {
+            continue;
+        }
+        if (maximum_false < m_criterion.apply(snapshot, incoming, constituents { candidate })) {
+            matches.emplace_back(i);
+        }
+    }
+
+    merge(std::move(event), matches);
+    m_supervisor.set_queue_size(open_constructors());
+    return 0;
+}
+
+template <typename Criterion>
+void coincidence_filter<Criterion>::run(std::vector<component_t>& components)
+{
+    const snapshot_t snapshot { m_criterion.snapshot() };
+    m_pool->run(components.size(), [&](std::size_t i) { match(snapshot, components[i]); });
+}
+
+template <typename Criterion>
+void coincidence_filter<Criterion>::match(const snapshot_t& snapshot, component_t& component) const
+{
+    const double maximum_false { m_criterion.maximum_false() };
+    auto& open { component.open };
+
+    std::vector<std::size_t> matches {};
+    for (auto& [event, finished] : component.events) {
+        const constituents incoming { event };
+        matches.clear();
+        for (std::size_t i { 0 }; i < open.size(); i++) {
+            const event_t& candidate { open[i].event };
+            // with a single thread, this constructor would have been sent off before the event arrived
+            if (constituents { candidate }.last() < finished) {
+                continue;
+            }
+            if (shares_station(event, candidate)) {
+                continue;
+            }
+            if (maximum_false < m_criterion.apply(snapshot, incoming, constituents { candidate })) {
+                matches.emplace_back(i);
+            }
+        }
+
+        if (matches.empty()) {
+            event_constructor constructor {};
+            constructor.event = std::move(event);
+            constructor.timeout = m_timeout;
+            open.emplace_back(std::move(constructor));
+            continue;
+        }
+
+        // Combines all contesting constructors into the first one
+        event_t& target { open[matches.front()].event };
+        combine(target, std::move(event));
+        for (auto it { matches.rbegin() }; it != std::prev(matches.rend()); ++it) {
+            target.emplace(std::move(open[*it].event));
+            open.erase(open.begin() + static_cast<std::ptrdiff_t>(*it));
+        }
+    }
+}
+
+template <typename Criterion>
+auto coincidence_filter<Criterion>::window() const -> std::int64_t
+{
+    return m_criterion.window();
+}
+
+template <typename Criterion>
+auto coincidence_filter<Criterion>::used_criterion() -> criterion&
+{
+    return m_criterion;
+}
+
 }
 
 #endif // COINCIDENCEFILTER_H
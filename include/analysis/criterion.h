@@ -1,11 +1,75 @@
 #ifndef CRITERION_H
 #define CRITERION_H
 
+#include "messages/event.h"
+
+#include <algorithm>
+#include <cstddef>
 #include <memory>
 
 namespace muonpi {
 
-struct event_t;
+/**
+ * @brief The constituents class. A non-owning view of the constituent records of an event.
+ * An event from a single station is viewed as one record, so criteria need no special case for it.
+ * The view is only valid as long as the event it was created from.
+ */
+class constituents {
+public:
+    /**
+     * @brief constituents Creates a view of all constituents of an event
+     * @param event The event to view
+     */
+    explicit constituents(const event_t& event) noexcept
+        : m_begin { (event.events.size() > 1) ? event.events.data() : &event.data }
+        , m_size { std::max<std::size_t>(event.events.size(), 1) }
+        , m_start { event.data.start }
+        , m_end { (m_size > 1) ? event.data.end : event.data.start }
+    {
+    }
+
+    [[nodiscard]] auto begin() const noexcept -> const event_t::data_t*
+    {
+        return m_begin;
+    }
+
+    [[nodiscard]] auto end() const noexcept -> const event_t::data_t*
+    {
+        return m_begin + m_size;
+    }
+
+    [[nodiscard]] auto size() const noexcept -> std::size_t
+    {
+        return m_size;
+    }
+
+    [[nodiscard]] auto operator[](std::size_t i) const noexcept -> const event_t::data_t&
+    {
+        return m_begin[i];
+    }
+
+    /**
+     * @brief start The earliest start time of all constituents
+     */
+    [[nodiscard]] auto start() const noexcept -> std::int_fast64_t
+    {
+        return m_start;
+    }
+
+    /**
+     * @brief last The latest start time of all constituents
+     */
+    [[nodiscard]] auto last() const noexcept -> std::int_fast64_t
+    {
+        return m_end;
+    }
+
+private:
+    const event_t::data_t* m_begin { nullptr };
+    std::size_t m_size { 0 };
+    std::int_fast64_t m_start {};
+    std::int_fast64_t m_end {};
+};
 
 /**
  * @brief The Criterion class
@@ -13,14 +77,55 @@ struct event_t;
  */
 class criterion {
 public:
+    /**
+     * @brief The snapshot_t struct. The data of a criterion which can change while it is in use.
+     * Criteria which keep such data shadow it with their own type, together with snapshot and the apply overload taking it.
+     */
+    struct snapshot_t {
+    };
+
     virtual ~criterion() = default;
+
+    /**
+     * @brief snapshot Takes a snapshot to match a batch of events with, which stays valid however the criterion changes in the meantime.
+     * @return The snapshot. Criteria without changing data return an empty one.
+     */
+    [[nodiscard]] auto snapshot() const -> snapshot_t
+    {
+        return {};
+    }
+
+    /**
+     * @brief apply Assigns a value to a pair of events using a snapshot taken before, without synchronising with changes of the criterion
+     * @param snapshot The snapshot to use
+     * @param first The constituents of the first event to check
+     * @param second The constituents of the second event to check
+     * @return the same as apply without a snapshot
+     */
+    [[nodiscard]] auto apply(const snapshot_t& /*snapshot*/, const constituents& first, const constituents& second) const -> double
+    {
+        return apply(first, second);
+    }
+
     /**
      * @brief apply Assigns a value of type T to a pair of events
-     * @param first The first event to check
-     * @param second the second event to check
+     * @param first The constituents of the first event to check
+     * @param second The constituents of the second event to check
      * @return a value of type T corresponding to the relationship between both events
      */
-    [[nodiscard]] virtual auto apply(const event_t& first, const event_t& second) const -> double = 0;
+    [[nodiscard]] virtual auto apply(const constituents& first, const constituents& second) const -> double = 0;
+
+    /**
+     * @brief window
+     * @return The largest time difference in ns between two constituents for which the criterion can still be true.
+     */
+    [[nodiscard]] virtual auto window() const -> std::int_fast64_t = 0;
+
+    /**
+     * @brief maximum_distance
+     * @return The largest distance in meter between two stations for which the criterion can still be true. Infinite if the location is not used.
+     */
+    [[nodiscard]] virtual auto maximum_distance() const -> double = 0;
 
     /**
      * @brief maximum_false
@@ -33,6 +138,19 @@ public:
      * @return The lower limit where the criterion is true.
      */
     [[nodiscard]] virtual auto minimum_true() const -> double = 0;
+
+    /**
+     * @brief set_location Updates the location of a station. Criteria which do not use the location ignore it.
+     * @param hash The hash of the station
+     * @param location The new location of the station
+     */
+    virtual void set_location(std::uint64_t /*hash*/, const location_t& /*location*/) { }
+
+    /**
+     * @brief remove Removes a station. Criteria which keep no data per station ignore it.
+     * @param hash The hash of the station
+     */
+    virtual void remove(std::uint64_t /*hash*/) { }
 };
 
 }
@@ -2,6 +2,7 @@
 #define DATASERIES_H
 
 #include "analysis/cachedvalue.h"
+#include "utility/binarystream.h"
 
 #include <algorithm>
 #include <array>
@@ -60,6 +61,19 @@ public:
      */
     [[nodiscard]] auto current() const -> T;
 
+    /**
+     * @brief save Writes the stored values to a binary snapshot
+     * @param out The writer to use
+     */
+    void save(binary_writer& out) const;
+
+    /**
+     * @brief load Restores the values previously written with save
+     * @param in The reader to use
+     * @return true if the values could be restored
+     */
+    [[nodiscard]] auto load(binary_reader& in) -> bool;
+
 private:
     [[nodiscard]] inline auto private_mean() const -> T
     {
@@ -154,5 +168,31 @@ auto data_series<T, N, Sample>::current() const -> T
     return m_buffer[m_index];
 }
 
+template <typename T, std::size_t N, bool Sample>
+void data_series<T, N, Sample>::save(binary_writer& out) const
+{
+    out.write(static_cast<std::uint64_t>(m_index));
+    out.write(static_cast<std::uint8_t>(m_full));
+    out.write(m_buffer);
+}
+
+template <typename T, std::size_t N, bool Sample>
+auto data_series<T, N, Sample>::load(binary_reader& in) -> bool
+{
+    std::uint64_t index {};
+    std::uint8_t full {};
+    std::array<T, N> buffer {};
+    if (!in.read(index) || !in.read(full) || !in.read(buffer) || (index >= N)) {
+        return false;
+    }
+    m_buffer = buffer;
+    m_index = static_cast<std::size_t>(index);
+    m_full = (full != 0);
+    m_mean_dirty = true;
+    m_stddev_dirty = true;
+    m_var_dirty = true;
+    return true;
+}
+
 }
 #endif // DATASERIES_H
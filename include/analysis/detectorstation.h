@@ -6,9 +6,11 @@
 #include "messages/detectorstatus.h"
 #include "messages/detectorsummary.h"
 #include "messages/userinfo.h"
+#include "utility/binarystream.h"
 #include "utility/threadrunner.h"
 
 #include "analysis/dataseries.h"
+#include "analysis/detectortable.h"
 #include "analysis/ratemeasurement.h"
 
 #include <chrono>
@@ -32,15 +34,17 @@ namespace supervision {
 class detector_station {
 public:
     /**
-     * @brief enable Enable the detector_station object so it has the status Enabled
+     * @brief enable Enable the detector_station object so it has the status Enabled.
+     * If the detector was restored from a snapshot, it continues with the status it had when the snapshot was written.
      */
     void enable();
 
     /**
      * @brief detector
      * @param initial_log The initial log message from which this detector object originates
+     * @param table The table which holds the numeric state of all detectors
      */
-    detector_station(const detector_info_t<location_t>& initial_log, supervision::station& stationsupervisor);
+    detector_station(const detector_info_t<location_t>& initial_log, detector_table& table, supervision::station& stationsupervisor);
 
     /**
      * @brief process Processes an event message. This means it calculates the event rate from this detector.
@@ -69,9 +73,36 @@ public:
     [[nodiscard]] auto factor() const -> double;
 
     /**
-     * @brief step Gets called by the supervision::station with a guaranteed maximum time delay. May be called more often.
+     * @brief step Gets called by the supervision::station once the current rate interval has passed. May be called more often.
+     * Steps the rate measurements and writes the results to the detector_table.
+     * @return The time point when this method should be called next
      */
-    void step(const std::chrono::system_clock::time_point& now);
+    [[nodiscard]] auto step(const std::chrono::system_clock::time_point& now) -> std::chrono::system_clock::time_point;
+
+    /**
+     * @brief save Writes the status and the rate and time accuracy histories of this detector to a binary snapshot
+     * @param out The writer to use
+     */
+    void save(binary_writer& out) const;
+
+    /**
+     * @brief restore Restores the state previously written with save. Has to be called before enable.
+     * @param in The reader to use
+     * @param last_log The time of the last log message before the snapshot was written
+     * @return true if the state could be restored
+     */
+    [[nodiscard]] auto restore(binary_reader& in, std::chrono::system_clock::time_point last_log) -> bool;
+
+    /**
+     * @brief row The row of this detector in the detector_table
+     */
+    [[nodiscard]] auto row() const -> std::size_t;
+
+    /**
+     * @brief set_row Gets called when the row of this detector was moved inside the detector_table
+     * @param row The new row
+     */
+    void set_row(std::size_t row);
 
     /**
      * @brief current_log_data gets the current log data.
@@ -105,23 +136,16 @@ protected:
     void set_status(detector_status::status status, detector_status::reason reason = detector_status::reason::miscellaneous);
 
 private:
-    /**
-     * @brief check_reliability Checks and sets the reliability of this detector object
-     */
-    void check_reliability();
-
-    detector_status::status m_status { detector_status::unreliable };
-
     bool m_initial { true };
+    detector_status::status m_restored_status { detector_status::created };
 
     location_t m_location {};
     std::size_t m_hash { 0 };
     userinfo_t m_userinfo {};
 
-    std::chrono::system_clock::time_point m_last_log { std::chrono::system_clock::now() };
+    detector_table& m_table;
+    std::size_t m_row { 0 };
 
-    static constexpr std::chrono::system_clock::duration s_log_interval { std::chrono::seconds { 90 } };
-    static constexpr std::chrono::system_clock::duration s_quit_interval { s_log_interval * 3 };
     static constexpr std::size_t s_history_length { 10 };
     static constexpr std::size_t s_time_interval { 30000 };
 
@@ -136,8 +160,6 @@ private:
     data_series<double, 100> m_pulselength {};
     data_series<double, 100> m_time_acc {}; //< ring buffer for time accuracy values provided by event messages (in ns)
     data_series<double, 5> m_reliability_time_acc {}; //< ring buffer for time accuracy for use as reliability measure
-
-    double m_factor { 1.0 };
 };
 
 }
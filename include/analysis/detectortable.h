@@ -0,0 +1,150 @@
+#ifndef DETECTORTABLE_H
+#define DETECTORTABLE_H
+
+#include "messages/detectorinfo.h"
+#include "messages/detectorstatus.h"
+#include "utility/units.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <functional>
+#include <vector>
+
+namespace muonpi {
+
+/**
+ * @brief The detector_table class
+ * Stores the numeric state of all detector stations in contiguous columns, one row per station.
+ * Every setter marks its row as dirty. The reliability and factor computation only runs for the dirty rows,
+ * so a step costs nothing for stations which neither sent data nor had a due maintenance task.
+ */
+class detector_table {
+public:
+    static constexpr double s_max_timing_error { 1000.0 * units::nanosecond }; //< max allowable timing error in nanoseconds
+    static constexpr double s_max_location_error { s_max_timing_error * consts::c_0 }; //< max allowable location error in meter
+    static constexpr double s_extreme_timing_error { s_max_timing_error * 100.0 };
+    static constexpr double s_stddev_factor { 0.75 };
+    static constexpr double s_hysteresis { 0.15 };
+
+    static constexpr std::chrono::system_clock::duration s_log_interval { std::chrono::seconds { 90 } };
+    static constexpr std::chrono::system_clock::duration s_quit_interval { s_log_interval * 3 };
+
+    /**
+     * @brief emplace Adds a new row for a detector station
+     * @param hash The hashed detector identifier
+     * @return The index of the new row
+     */
+    [[nodiscard]] auto emplace(std::size_t hash) -> std::size_t;
+
+    /**
+     * @brief erase Removes a row. The last row gets moved into its place.
+     * @param row The row to remove
+     * @return The hash of the detector which now occupies the row. Equal to the hash of the removed row if it was the last one.
+     */
+    [[nodiscard]] auto erase(std::size_t row) -> std::size_t;
+
+    /**
+     * @brief size The number of rows in the table
+     */
+    [[nodiscard]] auto size() const -> std::size_t;
+
+    /**
+     * @brief hash The hashed detector identifier of a row
+     */
+    [[nodiscard]] auto hash(std::size_t row) const -> std::size_t;
+
+    /**
+     * @brief status The current status of a row
+     */
+    [[nodiscard]] auto status(std::size_t row) const -> detector_status::status;
+
+    /**
+     * @brief factor The current rate factor of a row
+     */
+    [[nodiscard]] auto factor(std::size_t row) const -> double;
+
+    /**
+     * @brief last_log The time of the last log message of a row
+     */
+    [[nodiscard]] auto last_log(std::size_t row) const -> std::chrono::system_clock::time_point;
+
+    /**
+     * @brief set_status Overwrites the status of a row. Does not notify anyone.
+     */
+    void set_status(std::size_t row, detector_status::status status);
+
+    /**
+     * @brief set_rates Updates the rate statistics of a row
+     * @param current The mean of the current rate
+     * @param mean The long term mean rate
+     * @param stddev The long term standard deviation of the rate
+     */
+    void set_rates(std::size_t row, double current, double mean, double stddev);
+
+    /**
+     * @brief set_time_accuracy Updates the mean time accuracy used for the reliability
+     */
+    void set_time_accuracy(std::size_t row, double time_acc);
+
+    /**
+     * @brief set_location Updates the location precision and the time of the last log message
+     */
+    void set_location(std::size_t row, const location_t& location, std::chrono::system_clock::time_point time);
+
+    /**
+     * @brief check_log Checks whether the log interval of a row has expired. The result is used in the next step.
+     * @param row The row to check
+     * @param now The current time
+     * @return The time point when the log interval of this row needs to be checked next. time_point::max() if the detector is due for deletion.
+     */
+    [[nodiscard]] auto check_log(std::size_t row, const std::chrono::system_clock::time_point& now) -> std::chrono::system_clock::time_point;
+
+    /**
+     * @brief step Evaluates the reliability and factor of all rows which changed since the last step.
+     * @param on_change Gets called once for every row whose status changed in this step
+     * @return The largest factor of all reliable rows, at least 1.0
+     */
+    [[nodiscard]] auto step(const std::function<void(std::size_t, detector_status::status, detector_status::reason)>& on_change) -> double;
+
+private:
+    static constexpr std::int64_t s_flag_bad_location { 1 << 0 };
+    static constexpr std::int64_t s_flag_bad_time { 1 << 1 };
+    static constexpr std::int64_t s_flag_bad_rate { 1 << 2 };
+    static constexpr std::int64_t s_flag_good_location { 1 << 3 };
+    static constexpr std::int64_t s_flag_good_time { 1 << 4 };
+    static constexpr std::int64_t s_flag_good_rate { 1 << 5 };
+    static constexpr std::int64_t s_flag_missed_log { 1 << 6 };
+    static constexpr std::int64_t s_flag_quit { 1 << 7 };
+    static constexpr std::int64_t s_flag_good { s_flag_good_location | s_flag_good_time | s_flag_good_rate };
+
+    /**
+     * @brief mark Marks a row to be evaluated in the next step
+     * @param row The row to mark
+     */
+    void mark(std::size_t row);
+
+    /**
+     * @brief largest Recalculates the largest factor of all reliable rows
+     */
+    void largest();
+
+    std::vector<std::size_t> m_hash {};
+    std::vector<double> m_current_rate {};
+    std::vector<double> m_mean_rate {};
+    std::vector<double> m_stddev_rate {};
+    std::vector<double> m_time_acc {};
+    std::vector<double> m_loc_precision {};
+    std::vector<double> m_factor {};
+    std::vector<std::int64_t> m_last_log {};
+    std::vector<std::int64_t> m_log_flags {}; //< log interval flags set by check_log
+    std::vector<std::uint8_t> m_status {};
+    std::vector<std::uint8_t> m_marked {}; //< whether a row is in m_dirty
+
+    std::vector<std::size_t> m_dirty {}; //< rows to evaluate in the next step, may contain rows past the end after an erase
+    double m_largest { 1.0 }; //< largest factor of all reliable rows, kept up to date by step
+    bool m_largest_valid { true }; //< false if the row which held the largest factor changed
+};
+
+}
+
+#endif // DETECTORTABLE_H
@@ -2,6 +2,7 @@
 #define EVENTCONSTRUCTOR_H
 
 #include "messages/event.h"
+#include "utility/binarystream.h"
 
 #include <chrono>
 #include <memory>
@@ -33,6 +34,34 @@ public:
      */
     [[nodiscard]] auto timed_out(std::chrono::system_clock::time_point now) const -> bool;
 
+    /**
+     * @brief save Writes the constructor including its event to a binary checkpoint
+     * @param out The writer to use
+     */
+    void save(binary_writer& out) const;
+
+    /**
+     * @brief load Restores a constructor previously written with save
+     * @param in The reader to use
+     * @return true if the constructor could be restored
+     */
+    [[nodiscard]] auto load(binary_reader& in) -> bool;
+
+    /**
+     * @brief save_event Writes an event including its constituents to a binary checkpoint
+     * @param out The writer to use
+     * @param event The event to write
+     */
+    static void save_event(binary_writer& out, const event_t& event);
+
+    /**
+     * @brief load_event Restores an event previously written with save_event
+     * @param in The reader to use
+     * @param event The event to restore into, has to be empty
+     * @return true if the event could be restored
+     */
+    [[nodiscard]] static auto load_event(binary_reader& in, event_t& event) -> bool;
+
     event_t event;
     std::chrono::system_clock::duration timeout { std::chrono::minutes { 1 } };
 
@@ -4,12 +4,67 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cinttypes>
 #include <cmath>
 #include <functional>
 #include <numeric>
+#include <type_traits>
 
 namespace muonpi {
 
+/**
+ * @brief The binning class. Maps values onto the N equidistant bins of a histogram.
+ * For integral types the division is replaced by a shift if the bin width is a power of two,
+ * otherwise by a multiplication with the precomputed fixed point reciprocal followed by an exact correction.
+ * @param N the number of bins to use
+ * @param T The type of each datapoints
+ */
+template <std::size_t N, typename T>
+class binning {
+public:
+    static_assert(std::is_arithmetic<T>::value);
+
+    binning() = default;
+
+    /**
+     * @brief binning
+     * @param lower The lower bound of the first bin
+     * @param width The width of each bin
+     */
+    binning(T lower, T width);
+
+    /**
+     * @brief index Calculates the bin of a value
+     * @param value The value
+     * @return The index of the bin. N if the value is outside of the binning.
+     */
+    [[nodiscard]] inline auto index(T value) const -> std::size_t;
+
+    /**
+     * @brief index Calculates the bins of several values at once.
+     * The loop has no branches, so the compiler is able to vectorise it.
+     * @param values pointer to the first value
+     * @param count The number of values
+     * @param indices pointer to the first element of the output array. Values outside of the binning get the index N.
+     */
+    void index(const T* values, std::size_t count, std::uint32_t* indices) const;
+
+    [[nodiscard]] auto lower() const -> T;
+    [[nodiscard]] auto upper() const -> T;
+    [[nodiscard]] auto width() const -> T;
+
+private:
+    [[nodiscard]] inline auto unchecked(T value) const -> std::size_t;
+
+    T m_lower {};
+    T m_upper {};
+    T m_width {};
+    std::uint32_t m_reciprocal {}; //< 2^32 / width, rounded up
+    std::uint32_t m_shift {}; //< shift to use instead of the division if the width is a power of two
+    bool m_power_of_two { false };
+    bool m_wide { false }; //< true if the range does not fit into 32 bit, the reciprocal is not exact enough in that case
+};
+
 /**
  * @brief The histogram class
  * @param N the number of bins to use
@@ -48,8 +103,25 @@ public:
      * The value is deemed inside the histogram interval when it is >= lower and < upper.
      * If the value is exactly on the bound between two bins, the upper one is chosen.
      * @param value The value to add.
+     * @return The index of the bin the value was added to. N if the value is outside of the histogram.
+     */
+    auto add(T value) -> std::size_t;
+
+    /**
+     * @brief add Adds several values to the histogram at once.
+     * The bin indices are calculated block wise in a vectorisable loop, the bins are incremented afterwards.
+     * @param values pointer to the first value
+     * @param count The number of values
+     * @return The number of values which were inside of the histogram
+     */
+    auto add(const T* values, std::size_t count) -> std::size_t;
+
+    /**
+     * @brief increment Increments the count of one bin directly
+     * @param index The index of the bin
+     * @param n The amount to add
      */
-    void add(T value);
+    void increment(std::size_t index, C n = 1);
 
     /**
      * @brief bins Get all bins
@@ -63,6 +135,18 @@ public:
      */
     [[nodiscard]] auto qualified_bins() const -> std::vector<bin>;
 
+    /**
+     * @brief for_each_bin Calls a function for every non-empty bin, in ascending order
+     * @param function The function to call with the bin index and its count
+     */
+    void for_each_bin(const std::function<void(std::size_t, C)>& function) const;
+
+    /**
+     * @brief lower Get the lower bound of this histogram
+     * @return
+     */
+    [[nodiscard]] auto lower() const -> T;
+
     /**
      * @brief width Get the binwidth of this histogram
      * @return
@@ -81,9 +165,7 @@ public:
     void clear();
 
 private:
-    T m_lower {};
-    T m_upper {};
-    T m_width {};
+    binning<N, T> m_binning {};
     std::array<C, N> m_bins {};
 };
 
@@ -91,40 +173,170 @@ private:
 // implementation part starts here
 // +++++++++++++++++++++++++++++++
 
+template <std::size_t N, typename T>
+binning<N, T>::binning(T lower, T width)
+    : m_lower { lower }
+    , m_upper { static_cast<T>(lower + width * static_cast<T>(N)) }
+    , m_width { width }
+{
+    if (!(m_width > T {})) {
+        m_upper = m_lower;
+        return;
+    }
+    if constexpr (std::is_integral_v<T>) {
+        const auto w { static_cast<std::uint64_t>(m_width) };
+        const auto range { static_cast<std::uint64_t>(static_cast<std::int64_t>(m_upper) - static_cast<std::int64_t>(m_lower)) };
+        m_wide = ((range + w) >> 32U) > 0;
+        m_power_of_two = (w & (w - 1)) == 0;
+        while ((std::uint64_t { 1 } << m_shift) < w) {
+            m_shift++;
+        }
+        if (!m_power_of_two) {
+            m_reciprocal = static_cast<std::uint32_t>(((std::uint64_t { 1 } << 32U) + w - 1) / w);
+        }
+    }
+}
+
+template <std::size_t N, typename T>
+auto binning<N, T>::unchecked(T value) const -> std::size_t
+{
+    if constexpr (std::is_integral_v<T>) {
+        if (m_wide) {
+            return static_cast<std::size_t>(static_cast<std::uint64_t>(static_cast<std::int64_t>(value) - static_cast<std::int64_t>(m_lower)) / static_cast<std::uint64_t>(m_width));
+        }
+        const auto offset { static_cast<std::uint32_t>(static_cast<std::int64_t>(value) - static_cast<std::int64_t>(m_lower)) };
+        if (m_power_of_two) {
+            return offset >> m_shift;
+        }
+        // the estimate is either exact or one too large
+        auto i { static_cast<std::uint32_t>((static_cast<std::uint64_t>(offset) * m_reciprocal) >> 32U) };
+        i -= static_cast<std::uint32_t>((i * static_cast<std::uint32_t>(m_width)) > offset);
+        return i;
+    } else {
+        if (!(m_width > T {})) {
+            return 0;
+        }
+        return std::min<std::size_t>(static_cast<std::size_t>(std::floor((value - m_lower) / m_width)), N - 1);
+    }
+}
+
+template <std::size_t N, typename T>
+auto binning<N, T>::index(T value) const -> std::size_t
+{
+    if ((value < m_lower) || (value >= m_upper)) {
+        return N;
+    }
+    return unchecked(value);
+}
+
+template <std::size_t N, typename T>
+void binning<N, T>::index(const T* values, std::size_t count, std::uint32_t* indices) const
+{
+    if constexpr (std::is_integral_v<T> && (sizeof(T) <= sizeof(std::uint32_t))) {
+        // +++ 32 bit kernels, the compiler turns these into SIMD code
+        if (!m_wide && !m_power_of_two) {
+            const auto width { static_cast<std::uint32_t>(m_width) };
+            for (std::size_t i { 0 }; i < count; i++) {
+                const T value { values[i] };
+                const bool inside { (value >= m_lower) && (value < m_upper) };
+                const auto offset { static_cast<std::uint32_t>(static_cast<std::int64_t>(inside ? value : m_lower) - static_cast<std::int64_t>(m_lower)) };
+                auto bin { static_cast<std::uint32_t>((static_cast<std::uint64_t>(offset) * m_reciprocal) >> 32U) };
+                bin -= static_cast<std::uint32_t>((bin * width) > offset);
+                indices[i] = inside ? bin : static_cast<std::uint32_t>(N);
+            }
+            return;
+        }
+        if (!m_wide) {
+            for (std::size_t i { 0 }; i < count; i++) {
+                const T value { values[i] };
+                const bool inside { (value >= m_lower) && (value < m_upper) };
+                const auto offset { static_cast<std::uint32_t>(static_cast<std::int64_t>(inside ? value : m_lower) - static_cast<std::int64_t>(m_lower)) };
+                indices[i] = inside ? (offset >> m_shift) : static_cast<std::uint32_t>(N);
+            }
+            return;
+        }
+        // --- 32 bit kernels
+    }
+    for (std::size_t i { 0 }; i < count; i++) {
+        const T value { values[i] };
+        const bool inside { (value >= m_lower) && (value < m_upper) };
+        const std::size_t bin { unchecked(inside ? value : m_lower) };
+        indices[i] = static_cast<std::uint32_t>(inside ? bin : N);
+    }
+}
+
+template <std::size_t N, typename T>
+auto binning<N, T>::lower() const -> T
+{
+    return m_lower;
+}
+
+template <std::size_t N, typename T>
+auto binning<N, T>::upper() const -> T
+{
+    return m_upper;
+}
+
+template <std::size_t N, typename T>
+auto binning<N, T>::width() const -> T
+{
+    return m_width;
+}
+
 template <std::size_t N, typename T, typename C>
 histogram<N, T, C>::histogram()
-    : m_lower {}
-    , m_upper {}
-    , m_width {}
+    : m_binning {}
 {
 }
 
 template <std::size_t N, typename T, typename C>
 histogram<N, T, C>::histogram(T width)
-    : m_lower {}
-    , m_upper { width * N }
-    , m_width { width }
+    : m_binning { T {}, width }
 {
 }
 
 template <std::size_t N, typename T, typename C>
 histogram<N, T, C>::histogram(T lower, T upper)
-    : m_lower { lower }
-    , m_upper { upper }
-    , m_width { (upper - lower) / static_cast<T>(N) }
+    : m_binning { lower, (upper - lower) / static_cast<T>(N) }
 {
 }
 
 template <std::size_t N, typename T, typename C>
-void histogram<N, T, C>::add(T value)
+auto histogram<N, T, C>::add(T value) -> std::size_t
 {
-    if ((value < m_lower) || (value >= m_upper)) {
-        return;
+    const std::size_t i { m_binning.index(value) };
+    if (i < N) {
+        m_bins[i]++;
     }
+    return i;
+}
 
-    const std::size_t i { static_cast<std::size_t>(std::floor((value - m_lower) / m_width)) };
+template <std::size_t N, typename T, typename C>
+auto histogram<N, T, C>::add(const T* values, std::size_t count) -> std::size_t
+{
+    constexpr static std::size_t block { 64 };
+    std::array<std::uint32_t, block> indices {};
+    std::size_t added { 0 };
+    for (std::size_t offset { 0 }; offset < count; offset += block) {
+        const std::size_t n { std::min(block, count - offset) };
+        m_binning.index(values + offset, n, indices.data());
+        for (std::size_t i { 0 }; i < n; i++) {
+            if (indices[i] < N) {
+                m_bins[indices[i]]++;
+                added++;
+            }
+        }
+    }
+    return added;
+}
 
-    m_bins[i]++;
+template <std::size_t N, typename T, typename C>
+void histogram<N, T, C>::increment(std::size_t index, C n)
+{
+    if (index >= N) {
+        return;
+    }
+    m_bins[index] += n;
 }
 
 template <std::size_t N, typename T, typename C>
@@ -137,11 +349,11 @@ template <std::size_t N, typename T, typename C>
 auto histogram<N, T, C>::qualified_bins() const -> std::vector<bin>
 {
     std::vector<bin> bins;
-    T last { m_lower };
+    T last { m_binning.lower() };
     for (auto& b : m_bins) {
         bin current {};
         current.lower = last;
-        last += m_width;
+        last += m_binning.width();
         current.upper = last;
         current.count = b;
         bins.emplace_back(std::move(current));
@@ -149,10 +361,26 @@ auto histogram<N, T, C>::qualified_bins() const -> std::vector<bin>
     return bins;
 }
 
+template <std::size_t N, typename T, typename C>
+void histogram<N, T, C>::for_each_bin(const std::function<void(std::size_t, C)>& function) const
+{
+    for (std::size_t i { 0 }; i < N; i++) {
+        if (m_bins[i] != 0) {
+            function(i, m_bins[i]);
+        }
+    }
+}
+
+template <std::size_t N, typename T, typename C>
+auto histogram<N, T, C>::lower() const -> T
+{
+    return m_binning.lower();
+}
+
 template <std::size_t N, typename T, typename C>
 auto histogram<N, T, C>::width() const -> T
 {
-    return m_width;
+    return m_binning.width();
 }
 
 template <std::size_t N, typename T, typename C>
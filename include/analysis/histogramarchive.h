@@ -0,0 +1,202 @@
+#ifndef HISTOGRAMARCHIVE_H
+#define HISTOGRAMARCHIVE_H
+
+#include <cinttypes>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace muonpi::archive {
+
+/**
+ * Layout of a histogram archive file. All values are stored in native byte order.
+ *
+ * header
+ * station table   station_count * station_entry_t, followed by the concatenated site ids
+ * pair index      pair_count * pair_entry_t, sorted by first and second station index
+ * bin data        per pair a sequence of varint encoded (bin index delta, count) tuples, one per non-empty bin
+ *
+ * Only pairs with at least one entry are stored.
+ * Pairs which were only counted have no bin data, their size is 0 and total holds the number of coincidences.
+ */
+
+constexpr std::uint32_t s_magic { 0x5241484d };
+constexpr std::uint16_t s_version { 1 };
+
+/**
+ * @brief The station_t struct. One station in the archive.
+ */
+struct station_t {
+    std::uint64_t hash {};
+    std::string site_id {};
+    double lat {};
+    double lon {};
+    double h {};
+};
+
+/**
+ * @brief The pair_t struct. The metadata of one station pair in the archive.
+ */
+struct pair_t {
+    std::uint32_t first {}; //< index of the first station in the station table
+    std::uint32_t second {}; //< index of the second station in the station table
+    float distance {}; //< distance between the stations in meter
+    std::int32_t lower {}; //< lower bound of the histogram in ns
+    std::int32_t width {}; //< width of each bin in ns
+    std::int32_t uptime {}; //< time both stations were reliable in minutes
+    std::uint64_t total {}; //< total number of entries
+    std::uint64_t offset {}; //< offset of the bin data relative to the start of the bin data section
+    std::uint64_t size {}; //< size of the bin data in bytes
+};
+
+/**
+ * @brief The writer class. Collects the histograms of one sample period and writes them into a single archive file.
+ */
+class writer {
+public:
+    /**
+     * @brief writer
+     * @param start The start of the sample period, in ns since epoch
+     * @param end The end of the sample period, in ns since epoch
+     * @param bins The number of bins of each histogram
+     */
+    writer(std::int64_t start, std::int64_t end, std::uint32_t bins);
+
+    /**
+     * @brief add_station Adds a station to the station table
+     * @param station The station to add
+     * @return The index of the station
+     */
+    auto add_station(station_t station) -> std::uint32_t;
+
+    /**
+     * @brief add_pair Adds the histogram of a station pair. Empty histograms are only kept as a pair without bin data if the pair has an uptime.
+     * @param pair The metadata of the pair. total, offset and size are determined by this method.
+     * @param hist The histogram. Any histogram type providing for_each_bin with the number of bins given in the constructor.
+     */
+    template <typename H>
+    void add_pair(pair_t pair, const H& hist);
+
+    /**
+     * @brief add_count Adds a station pair for which only the number of coincidences is known. Pairs without entries and uptime are skipped.
+     * @param pair The metadata of the pair, with total set to the number of coincidences.
+     */
+    void add_count(pair_t pair);
+
+    /**
+     * @brief write Writes the archive. The file is written under a temporary name first and renamed once it is complete.
+     * @param path The path of the archive file
+     * @return true if the archive was written
+     */
+    [[nodiscard]] auto write(const std::string& path) const -> bool;
+
+private:
+    void encode(std::uint64_t value);
+
+    std::int64_t m_start {};
+    std::int64_t m_end {};
+    std::uint32_t m_bins {};
+
+    std::vector<station_t> m_stations {};
+    std::vector<pair_t> m_pairs {};
+    std::string m_data {};
+};
+
+/**
+ * @brief The reader class. Maps an archive file into memory and decodes the histograms on demand.
+ */
+class reader {
+public:
+    reader() = default;
+    ~reader();
+
+    reader(const reader&) = delete;
+    reader(reader&&) = delete;
+    auto operator=(const reader&) -> reader& = delete;
+    auto operator=(reader&&) -> reader& = delete;
+
+    /**
+     * @brief open Opens an archive file and reads its station table and pair index
+     * @param path The path of the archive file
+     * @return true if the file is a valid archive
+     */
+    [[nodiscard]] auto open(const std::string& path) -> bool;
+
+    /**
+     * @brief start The start of the sample period, in ns since epoch
+     */
+    [[nodiscard]] auto start() const -> std::int64_t;
+
+    /**
+     * @brief end The end of the sample period, in ns since epoch
+     */
+    [[nodiscard]] auto end() const -> std::int64_t;
+
+    /**
+     * @brief bins The number of bins of each histogram
+     */
+    [[nodiscard]] auto bins() const -> std::uint32_t;
+
+    /**
+     * @brief stations The station table
+     */
+    [[nodiscard]] auto stations() const -> const std::vector<station_t>&;
+
+    /**
+     * @brief pairs The pair index
+     */
+    [[nodiscard]] auto pairs() const -> const std::vector<pair_t>&;
+
+    /**
+     * @brief for_each_bin Decodes the histogram of a pair
+     * @param pair The pair to decode
+     * @param function Gets called once for every non-empty bin with the bin index and the count
+     * @return false if the bin data is corrupt
+     */
+    [[nodiscard]] auto for_each_bin(const pair_t& pair, const std::function<void(std::uint32_t, std::uint64_t)>& function) const -> bool;
+
+private:
+    void close();
+
+    const char* m_data { nullptr };
+    std::size_t m_size { 0 };
+    std::size_t m_bin_data { 0 };
+
+    std::int64_t m_start {};
+    std::int64_t m_end {};
+    std::uint32_t m_bins {};
+
+    std::vector<station_t> m_stations {};
+    std::vector<pair_t> m_pairs {};
+};
+
+// +++++++++++++++++++++++++++++++
+// implementation part starts here
+// +++++++++++++++++++++++++++++++
+
+template <typename H>
+void writer::add_pair(pair_t pair, const H& hist)
+{
+    pair.total = 0;
+    pair.offset = m_data.size();
+
+    std::size_t last { 0 };
+    hist.for_each_bin([&](std::size_t index, auto count) {
+        if ((index >= m_bins) || (count == 0)) {
+            return;
+        }
+        encode(index - last);
+        encode(static_cast<std::uint64_t>(count));
+        last = index;
+        pair.total += static_cast<std::uint64_t>(count);
+    });
+    pair.size = m_data.size() - pair.offset;
+    if ((pair.total == 0) && (pair.uptime == 0)) {
+        return;
+    }
+    m_pairs.emplace_back(pair);
+}
+
+}
+
+#endif // HISTOGRAMARCHIVE_H
@@ -0,0 +1,58 @@
+#ifndef QUANTILE_H
+#define QUANTILE_H
+
+#include <array>
+#include <cinttypes>
+
+namespace muonpi {
+
+/**
+ * @brief The p2_quantile class
+ * Streaming estimation of a single quantile with the P² algorithm by Jain and Chlamtac.
+ * Uses constant memory, five markers are moved along with the incoming values.
+ */
+class p2_quantile {
+public:
+    /**
+     * @brief p2_quantile
+     * @param p The quantile to estimate, between 0 and 1
+     */
+    explicit p2_quantile(double p);
+
+    /**
+     * @brief add Adds one observation
+     * @param value The observed value
+     */
+    void add(double value);
+
+    /**
+     * @brief value The current estimate of the quantile
+     * @return The estimate. 0 if there are no observations yet.
+     */
+    [[nodiscard]] auto value() const -> double;
+
+    /**
+     * @brief n The number of observations
+     */
+    [[nodiscard]] auto n() const -> std::size_t;
+
+    /**
+     * @brief reset Forgets all observations
+     */
+    void reset();
+
+private:
+    [[nodiscard]] auto parabolic(std::size_t i, double d) const -> double;
+    [[nodiscard]] auto linear(std::size_t i, std::int64_t d) const -> double;
+
+    double m_p {};
+    std::size_t m_n { 0 };
+    std::array<double, 5> m_heights {}; //< marker heights
+    std::array<std::int64_t, 5> m_positions {}; //< actual marker positions
+    std::array<double, 5> m_desired {}; //< desired marker positions
+    std::array<double, 5> m_increments {}; //< increments of the desired positions per observation
+};
+
+}
+
+#endif // QUANTILE_H
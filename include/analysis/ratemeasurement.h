@@ -39,6 +39,12 @@ public:
      */
     auto step(const std::chrono::system_clock::time_point& now) -> bool;
 
+    /**
+     * @brief next_step The time point at which the current interval ends
+     * @return The earliest time point at which step will determine new rates
+     */
+    [[nodiscard]] auto next_step() const -> std::chrono::system_clock::time_point;
+
 private:
     std::size_t m_current_n { 0 };
     std::chrono::system_clock::time_point m_last { std::chrono::system_clock::now() };
@@ -73,5 +79,11 @@ auto rate_measurement<N, T, Sample>::step(const std::chrono::system_clock::time_
     return false;
 }
 
+template <std::size_t N, std::size_t T, bool Sample>
+auto rate_measurement<N, T, Sample>::next_step() const -> std::chrono::system_clock::time_point
+{
+    return m_last + std::chrono::milliseconds { T };
+}
+
 }
 #endif // RATEMEASUREMENT_H
@@ -4,6 +4,8 @@
 #include "analysis/criterion.h"
 
 #include <chrono>
+#include <cstdlib>
+#include <limits>
 #include <memory>
 
 namespace muonpi {
@@ -12,16 +14,36 @@ namespace muonpi {
  * @brief The Coincidence class
  * Defines the parameters for a coincidence between two events
  */
-class simple_coincidence : public criterion {
+class simple_coincidence final : public criterion {
 public:
+    using criterion::apply;
+
     ~simple_coincidence() override;
     /**
      * @brief criterion Assigns a value of type T to a pair of events
-     * @param first The first event to check
-     * @param second the second event to check
+     * @param first The constituents of the first event to check
+     * @param second The constituents of the second event to check
      * @return true if the events have a coincidence
      */
-    [[nodiscard]] auto apply(const event_t& first, const event_t& second) const -> double override;
+    [[nodiscard]] auto apply(const constituents& first, const constituents& second) const -> double override;
+
+    /**
+     * @brief window
+     * @return The largest time difference in ns between two constituents for which the criterion can still be true.
+     */
+    [[nodiscard]] auto window() const -> std::int_fast64_t override
+    {
+        return m_time;
+    }
+
+    /**
+     * @brief maximum_distance
+     * @return Always infinite, the location is not used.
+     */
+    [[nodiscard]] auto maximum_distance() const -> double override
+    {
+        return std::numeric_limits<double>::infinity();
+    }
 
     /**
      * @brief maximum_false
@@ -52,6 +74,26 @@ private:
     std::int_fast64_t m_time { 100000 };
 };
 
+// +++++++++++++++++++++++++++++++
+// implementation part starts here
+// +++++++++++++++++++++++++++++++
+
+inline auto simple_coincidence::apply(const constituents& first, const constituents& second) const -> double
+{
+    const std::int_fast64_t t11 = first.start();
+    const std::int_fast64_t t21 = second.start();
+
+    const std::int_fast64_t t12 = first.last();
+    const std::int_fast64_t t22 = second.last();
+
+    return compare(t11, t21) + compare(t11, t22) + compare(t12, t21) + compare(t12, t22);
+}
+
+inline auto simple_coincidence::compare(std::int_fast64_t t1, std::int_fast64_t t2) const -> double
+{
+    return (std::abs(t1 - t2) <= m_time) ? 1.0 : -1.0;
+}
+
 }
 
 #endif // SIMPLECOINCIDENCE_H
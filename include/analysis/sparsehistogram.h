@@ -0,0 +1,270 @@
+#ifndef SPARSEHISTOGRAM_H
+#define SPARSEHISTOGRAM_H
+
+#include "analysis/histogram.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <functional>
+#include <vector>
+
+namespace muonpi {
+
+/**
+ * @brief The sparse_histogram class
+ * A histogram with the same binning as histogram, which only stores the bins that have entries.
+ * The bins are kept in a sorted list until the list would use more than half the memory of a dense bin array,
+ * at which point the histogram switches to dense storage.
+ * @param N the number of bins to use
+ * @param T The type of each datapoints
+ * @param C The type of the counter variable
+ */
+template <std::size_t N, typename T = double, typename C = std::size_t>
+class sparse_histogram {
+public:
+    static_assert(std::is_integral<C>::value);
+    static_assert(std::is_arithmetic<T>::value);
+
+    using bin = typename histogram<N, T, C>::bin;
+
+    explicit sparse_histogram();
+
+    /**
+     * @brief sparse_histogram Create a histogram between two values.
+     * @param lower The lower bound of the histogram
+     * @param upper The upper bound
+     */
+    explicit sparse_histogram(T lower, T upper);
+
+    /**
+     * @brief add Adds a value to the histogram.
+     * The value is deemed inside the histogram interval when it is >= lower and < upper.
+     * @param value The value to add.
+     * @return The index of the bin the value was added to. N if the value is outside of the histogram.
+     */
+    auto add(T value) -> std::size_t;
+
+    /**
+     * @brief add Adds several values to the histogram at once.
+     * The bin indices are calculated in a vectorisable loop and sorted, so every touched bin is looked up only once.
+     * @param values pointer to the first value
+     * @param count The number of values
+     * @return The number of values which were inside of the histogram
+     */
+    auto add(const T* values, std::size_t count) -> std::size_t;
+
+    /**
+     * @brief increment Increments the count of one bin directly
+     * @param index The index of the bin
+     * @param n The amount to add
+     */
+    void increment(std::size_t index, C n = 1);
+
+    /**
+     * @brief qualified_bins Get all bins, including the empty ones
+     * @return a vector containing all N bins
+     */
+    [[nodiscard]] auto qualified_bins() const -> std::vector<bin>;
+
+    /**
+     * @brief for_each_bin Calls a function for every non-empty bin, in ascending order
+     * @param function The function to call with the bin index and its count
+     */
+    void for_each_bin(const std::function<void(std::size_t, C)>& function) const;
+
+    /**
+     * @brief lower Get the lower bound of this histogram
+     */
+    [[nodiscard]] auto lower() const -> T;
+
+    /**
+     * @brief width Get the binwidth of this histogram
+     */
+    [[nodiscard]] auto width() const -> T;
+
+    /**
+     * @brief integral get the total number of entries
+     */
+    [[nodiscard]] auto integral() const -> std::uint64_t;
+
+    /**
+     * @brief dense Whether this histogram has switched to dense storage
+     */
+    [[nodiscard]] auto dense() const -> bool;
+
+    /**
+     * @brief empty Whether this histogram holds no bin storage at all
+     */
+    [[nodiscard]] auto empty() const -> bool;
+
+    /**
+     * @brief clear Removes all entries and releases the bin storage
+     */
+    void clear();
+
+private:
+    struct entry {
+        std::uint32_t index {};
+        C count {};
+    };
+
+    static constexpr std::size_t s_threshold { (N * sizeof(C)) / (2 * sizeof(entry)) }; //< number of sparse entries after which dense storage is used
+
+    binning<N, T> m_binning {};
+    std::vector<entry> m_sparse {};
+    std::vector<C> m_dense {};
+};
+
+// +++++++++++++++++++++++++++++++
+// implementation part starts here
+// +++++++++++++++++++++++++++++++
+
+template <std::size_t N, typename T, typename C>
+sparse_histogram<N, T, C>::sparse_histogram()
+    : m_binning {}
+{
+}
+
+template <std::size_t N, typename T, typename C>
+sparse_histogram<N, T, C>::sparse_histogram(T lower, T upper)
+    : m_binning { lower, (upper - lower) / static_cast<T>(N) }
+{
+}
+
+template <std::size_t N, typename T, typename C>
+auto sparse_histogram<N, T, C>::add(T value) -> std::size_t
+{
+    const std::size_t i { m_binning.index(value) };
+    increment(i);
+    return i;
+}
+
+template <std::size_t N, typename T, typename C>
+auto sparse_histogram<N, T, C>::add(const T* values, std::size_t count) -> std::size_t
+{
+    std::vector<std::uint32_t> indices(count);
+    m_binning.index(values, count, indices.data());
+    std::sort(indices.begin(), indices.end());
+
+    std::size_t added { 0 };
+    for (auto it { indices.begin() }; (it != indices.end()) && (*it < N);) {
+        const auto end { std::upper_bound(it, indices.end(), *it) };
+        const auto n { static_cast<std::size_t>(std::distance(it, end)) };
+        increment(*it, static_cast<C>(n));
+        added += n;
+        it = end;
+    }
+    return added;
+}
+
+template <std::size_t N, typename T, typename C>
+void sparse_histogram<N, T, C>::increment(std::size_t index, C n)
+{
+    if (index >= N) {
+        return;
+    }
+    if (!m_dense.empty()) {
+        m_dense[index] += n;
+        return;
+    }
+
+    auto it { std::lower_bound(m_sparse.begin(), m_sparse.end(), index, [](const entry& e, std::size_t i) { return e.index < i; }) };
+    if ((it != m_sparse.end()) && (it->index == index)) {
+        it->count += n;
+        return;
+    }
+    if (m_sparse.size() < s_threshold) {
+        m_sparse.insert(it, entry { static_cast<std::uint32_t>(index), n });
+        return;
+    }
+
+    // +++ switch to dense storage
+    m_dense.assign(N, C {});
+    for (const auto& e : m_sparse) {
+        m_dense[e.index] = e.count;
+    }
+    m_sparse.clear();
+    m_sparse.shrink_to_fit();
+    m_dense[index] += n;
+    // --- switch to dense storage
+}
+
+template <std::size_t N, typename T, typename C>
+auto sparse_histogram<N, T, C>::qualified_bins() const -> std::vector<bin>
+{
+    std::vector<bin> bins {};
+    bins.resize(N);
+    T last { m_binning.lower() };
+    for (auto& b : bins) {
+        b.lower = last;
+        last += m_binning.width();
+        b.upper = last;
+    }
+    for_each_bin([&](std::size_t index, C count) {
+        bins[index].count = count;
+    });
+    return bins;
+}
+
+template <std::size_t N, typename T, typename C>
+void sparse_histogram<N, T, C>::for_each_bin(const std::function<void(std::size_t, C)>& function) const
+{
+    if (!m_dense.empty()) {
+        for (std::size_t i { 0 }; i < N; i++) {
+            if (m_dense[i] != 0) {
+                function(i, m_dense[i]);
+            }
+        }
+        return;
+    }
+    for (const auto& e : m_sparse) {
+        function(e.index, e.count);
+    }
+}
+
+template <std::size_t N, typename T, typename C>
+auto sparse_histogram<N, T, C>::lower() const -> T
+{
+    return m_binning.lower();
+}
+
+template <std::size_t N, typename T, typename C>
+auto sparse_histogram<N, T, C>::width() const -> T
+{
+    return m_binning.width();
+}
+
+template <std::size_t N, typename T, typename C>
+auto sparse_histogram<N, T, C>::integral() const -> std::uint64_t
+{
+    std::uint64_t total {};
+    for (const auto& n : m_dense) {
+        total += n;
+    }
+    for (const auto& e : m_sparse) {
+        total += e.count;
+    }
+    return total;
+}
+
+template <std::size_t N, typename T, typename C>
+auto sparse_histogram<N, T, C>::dense() const -> bool
+{
+    return !m_dense.empty();
+}
+
+template <std::size_t N, typename T, typename C>
+auto sparse_histogram<N, T, C>::empty() const -> bool
+{
+    return m_sparse.empty() && m_dense.empty();
+}
+
+template <std::size_t N, typename T, typename C>
+void sparse_histogram<N, T, C>::clear()
+{
+    m_sparse = {};
+    m_dense = {};
+}
+
+}
+#endif // SPARSEHISTOGRAM_H
@@ -1,6 +1,8 @@
 ﻿#ifndef STATION_COINCIDENCE_H
 #define STATION_COINCIDENCE_H
 
+#include "utility/mappedfile.h"
+#include "utility/spatialgrid.h"
 #include "utility/threadrunner.h"
 #include "utility/units.h"
 
@@ -9,10 +11,16 @@
 
 #include "sink/base.h"
 
-#include "analysis/histogram.h"
+#include "analysis/sparsehistogram.h"
 #include "analysis/uppermatrix.h"
 
+#include <array>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 namespace muonpi {
 
@@ -22,6 +30,9 @@ namespace supervision {
 
 /**
  * @brief The station_coincidence class. It stores histograms between all possible detector pairs.
+ * Each pair holds two generations of histograms. Events are added to the current generation,
+ * while a save swaps in the other one and writes the retired generation without blocking the event collection.
+ * Optionally only pairs closer than a maximum distance get histograms, all other pairs only count their coincidences.
  */
 class station_coincidence : public sink::base<event_t>, public sink::base<trigger::detector>, public thread_runner {
 public:
@@ -29,11 +40,14 @@ public:
      * @brief station_coincidence
      * @param data_directory The data directory to use to store the data
      * @param stationsupervisor reference to the supervision::station object
+     * @param max_distance The maximum distance between two stations in meter for which histograms are kept. 0 to keep histograms for all pairs.
      */
-    station_coincidence(std::string data_directory, supervision::station& stationsupervisor);
+    station_coincidence(std::string data_directory, supervision::station& stationsupervisor, double max_distance = 0.0);
 
     /**
      * @brief get Reimplemented from sink::base
+     * Must always be called from the same thread. This is the only place adding stations at runtime,
+     * which is what allows the station lookup here to run without a lock.
      * @param event the event to process
      */
     void get(event_t event) override;
@@ -50,10 +64,61 @@ protected:
     [[nodiscard]] auto post_run() -> int override;
 
 private:
+    /**
+     * @brief The journal_t struct. Collects the changes since the last checkpoint.
+     */
+    struct journal_t {
+        struct bin_t {
+            std::size_t first {};
+            std::size_t second {};
+            std::uint32_t index {};
+        };
+        std::vector<std::pair<userinfo_t, location_t>> stations {};
+        std::vector<bin_t> bins {};
+    };
+
     void save();
     void reset();
     void add_station(const userinfo_t& userinfo, const location_t& location);
 
+    /**
+     * @brief distance Calculates the straight distance between two stations
+     * @param first The index of the first station
+     * @param second The index of the second station
+     * @return The distance in meter
+     */
+    [[nodiscard]] auto distance(std::size_t first, std::size_t second) const -> double;
+
+    /**
+     * @brief distance Calculates the straight distance between two locations
+     * @return The distance in meter
+     */
+    [[nodiscard]] static auto distance(const location_t& first, const location_t& second) -> double;
+
+    /**
+     * @brief index_of Finds the index of a station. Constant time lookup in the station index.
+     * Requires either m_mutex or being called from the event thread, which is the only one modifying the index.
+     * @param hash The hashed station identifier
+     * @return The index of the station. The number of stations if it is not known.
+     */
+    [[nodiscard]] auto index_of(std::size_t hash) const -> std::size_t;
+
+    /**
+     * @brief checkpoint Appends all changes since the last checkpoint to the checkpoint file
+     */
+    void checkpoint();
+
+    /**
+     * @brief write_checkpoint Encodes a journal and appends it to the checkpoint file
+     * @param journal The journal to write
+     */
+    void write_checkpoint(const journal_t& journal);
+
+    /**
+     * @brief recover Opens the checkpoint file and merges the histograms stored in it
+     */
+    void recover();
+
     supervision::station& m_stationsupervisor;
 
     std::string m_data_directory {};
@@ -61,21 +126,31 @@ private:
     constexpr static std::size_t s_bins { 2000 }; //<! total number of bins to use per pair
     constexpr static double s_total_width { 2.0 * 100000.0 };
 
-    std::atomic<bool> m_saving { false };
+    constexpr static std::uint32_t s_checkpoint_magic { 0x5453434d };
+    constexpr static std::chrono::system_clock::duration s_checkpoint_interval { std::chrono::minutes { 1 } };
 
-    using histogram_t = histogram<s_bins, std::int32_t, std::uint32_t>;
+    using histogram_t = sparse_histogram<s_bins, std::int32_t, std::uint32_t>;
     struct data_t {
-        std::size_t first {};
-        std::size_t second {};
-        float distance {};
-        histogram_t hist {};
+        float distance {}; //< only calculated for pairs with histograms
+        std::unique_ptr<std::array<histogram_t, 2>> hist { nullptr }; //< one histogram per generation. Empty for pairs beyond the maximum distance.
+        std::array<std::uint32_t, 2> count {}; //< number of coincidences per generation for pairs without histograms
         std::uint8_t online { 2 };
         std::chrono::system_clock::time_point last_online { std::chrono::system_clock::now() };
         std::int32_t uptime { 0 };
     };
     std::vector<std::pair<userinfo_t, location_t>> m_stations {};
+    std::unordered_map<std::size_t, std::size_t> m_index {}; //< maps the station hash to its index in m_stations and m_data
     upper_matrix<data_t> m_data { 0 };
+    double m_max_distance {};
+    spatial_grid m_grid; //< contains all stations, used to find the close pairs when the maximum distance is set
+    std::size_t m_generation { 0 }; //< index of the current histogram generation
+    mutable std::shared_mutex m_mutex {}; //< exclusive for structural changes and the generation swap, shared for adding to the current generation
     std::chrono::system_clock::time_point m_last_save { std::chrono::system_clock::now() };
+    std::thread::id m_event_thread {}; //< the thread delivering events, set by the first event
+
+    std::mutex m_journal_mutex {};
+    journal_t m_journal {};
+    std::unique_ptr<mapped_file> m_checkpoint { nullptr };
 };
 
 }
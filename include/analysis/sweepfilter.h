@@ -0,0 +1,450 @@
+#ifndef SWEEPFILTER_H
+#define SWEEPFILTER_H
+
+#include "analysis/coincidenceengine.h"
+#include "analysis/criterion.h"
+#include "analysis/eventconstructor.h"
+#include "messages/event.h"
+#include "utility/binarystream.h"
+#include "utility/configuration.h"
+#include "utility/log.h"
+#include "utility/mappedfile.h"
+#include "utility/workerpool.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace muonpi {
+
+/**
+ * @brief The sweep_filter class
+ * Alternative to coincidence_filter, which matches the events in the order of their GNSS timestamps instead of their arrival.
+ * Incoming events are buffered in one time sorted stream per station.
+ * Once the watermark has passed an event, the streams are merged in time order
+ * and each event is matched against the coincidences which are still open at that point in time.
+ * A coincidence is sent off as soon as the sweep has passed its last constituent by more than the criterion window.
+ *
+ * With more than one thread, the events of one sweep are cut into time slices which are matched in parallel.
+ * Slices are only cut at gaps between two events larger than the criterion window. No coincidence can span such a gap,
+ * so the slices are independent and the result, including its order, is the same as with a single thread.
+ * A snapshot of the criterion is taken once per sweep, so the workers match without synchronising with each other or with updates of the criterion.
+ *
+ * The matching depends on the order of the events as soon as clusters overlap in time, since a merged coincidence is compared by all its constituents.
+ * The result therefore differs from coincidence_filter in the rare cases where the arrival order and the time order disagree within such an overlap.
+ *
+ * If a state file is configured, the buffered events and the open coincidences are written to a checkpoint periodically and on shutdown,
+ * and restored on the next start. Without one, all buffered events are swept and sent off on shutdown.
+ * @param Criterion The criterion to use. Needs to be default constructible and derived from criterion.
+ */
+template <typename Criterion>
+class sweep_filter : public coincidence_engine {
+public:
+    /**
+     * @brief sweep_filter
+     * @param event_sink A collection of event sinks to use
+     * @param supervisor A reference to a state_supervisor, which keeps track of program metadata
+     * @param threads The number of threads to use for matching
+     */
+    sweep_filter(sink::base<event_t>& event_sink, supervision::state& supervisor, std::size_t threads = 1);
+
+    ~sweep_filter() override = default;
+
+protected:
+    /**
+     * @brief process Called from step(). Buffers a new event in the stream of its station
+     * @param event The event to process
+     */
+    [[nodiscard]] auto process(event_t event) -> int override;
+
+    /**
+     * @brief process gets periodically called by sink::threaded. Sweeps up to the current watermark.
+     * @return
+     */
+    [[nodiscard]] auto process() -> int override;
+
+    /**
+     * @brief post_run Reimplemented from thread_runner. Writes a final checkpoint, or without one sweeps all buffered events and sends off all open coincidences.
+     */
+    [[nodiscard]] auto post_run() -> int override;
+
+    /**
+     * @brief used_criterion Reimplemented from coincidence_engine
+     */
+    [[nodiscard]] auto used_criterion() -> criterion& override;
+
+private:
+    using snapshot_t = typename Criterion::snapshot_t;
+    using head_t = std::pair<std::int64_t, std::uint64_t>; //< start of the first event in a stream and the station hash
+
+    /**
+     * @brief The slice_t struct. A part of one sweep which can be matched independently of the others.
+     */
+    struct slice_t {
+        std::size_t begin {}; //< index of the first event of the slice
+        std::size_t end {}; //< index past the last event of the slice
+        std::int64_t close {}; //< position up to which the open coincidences are closed after the last event
+        std::vector<event_t> open {};
+        std::vector<event_t> finished {};
+    };
+
+    /**
+     * @brief buffer Inserts an event into the stream of its station
+     * @param event The event to buffer
+     */
+    void buffer(event_t event);
+
+    /**
+     * @brief checkpoint Replaces the checkpoint file with a snapshot of the buffered events and the open coincidences
+     */
+    void checkpoint();
+
+    /**
+     * @brief recover Restores the buffered events and the open coincidences from the checkpoint file
+     */
+    void recover();
+
+    /**
+     * @brief sweep Matches all buffered events up to a point in time, in the order of their start time
+     * @param watermark The point in time in ns up to which all events are assumed to have arrived
+     */
+    void sweep(std::int64_t watermark);
+
+    /**
+     * @brief slice Cuts the events of one sweep into independent slices. Has to be called before the open coincidences are handed to the first slice.
+     * @param events The events of the sweep, sorted by their start time
+     * @param watermark The end of the sweep
+     * @return The slices, in time order
+     */
+    [[nodiscard]] auto slice(const std::vector<event_t>& events, std::int64_t watermark) const -> std::vector<slice_t>;
+
+    /**
+     * @brief run Matches all events of one slice
+     * @param snapshot The snapshot of the criterion taken for this sweep
+     * @param events The events of the sweep
+     * @param slice The slice to match
+     */
+    void run(const snapshot_t& snapshot, std::vector<event_t>& events, slice_t& slice) const;
+
+    /**
+     * @brief match Matches one event against the open coincidences
+     * @param snapshot The snapshot of the criterion taken for this sweep
+     * @param open The open coincidences
+     * @param event The event to match
+     */
+    void match(const snapshot_t& snapshot, std::vector<event_t>& open, event_t event) const;
+
+    /**
+     * @brief close Moves all coincidences which can not get any more constituents to the finished ones
+     * @param open The open coincidences
+     * @param finished The finished coincidences
+     * @param position The current position of the sweep in ns
+     */
+    void close(std::vector<event_t>& open, std::vector<event_t>& finished, std::int64_t position) const;
+
+    static constexpr std::size_t s_minimum_slice { 256 }; //< smallest number of events in a slice worth its own task
+    static constexpr std::uint32_t s_checkpoint_magic { 0x4a43534d };
+    static constexpr std::chrono::system_clock::duration s_checkpoint_interval { std::chrono::seconds { 1 } };
+    static constexpr std::uint8_t s_record_open { 0 };
+    static constexpr std::uint8_t s_record_buffered { 1 };
+
+    Criterion m_criterion {};
+    std::unique_ptr<worker_pool> m_pool { nullptr };
+
+    std::unordered_map<std::uint64_t, std::deque<event_t>> m_streams {}; //< buffered events per station, sorted by start time
+    std::priority_queue<head_t, std::vector<head_t>, std::greater<>> m_heads {}; //< may contain outdated entries, those are skipped
+    std::size_t m_buffered { 0 };
+
+    std::vector<event_t> m_open {}; //< coincidences which can still get more constituents
+
+    std::unique_ptr<mapped_file> m_checkpoint { nullptr };
+    std::chrono::system_clock::time_point m_last_checkpoint { std::chrono::system_clock::now() };
+    bool m_recovered { false };
+};
+
+// +++++++++++++++++++++++++++++++
+// implementation part starts here
+// +++++++++++++++++++++++++++++++
+
+template <typename Criterion>
+sweep_filter<Criterion>::sweep_filter(sink::base<event_t>& event_sink, supervision::state& supervisor, std::size_t threads)
+    : coincidence_engine { event_sink, supervisor }
+{
+    if (threads > 1) {
+        m_pool = std::make_unique<worker_pool>(threads);
+    }
+}
+
+template <typename Criterion>
+auto sweep_filter<Criterion>::process(event_t event) -> int
+{
+    m_supervisor.increase_event_count(true);
+    observe(event);
+    buffer(std::move(event));
+
+    m_supervisor.set_queue_size(m_buffered + m_open.size());
+    return 0;
+}
+
+template <typename Criterion>
+void sweep_filter<Criterion>::buffer(event_t event)
+{
+    const std::uint64_t hash { event.data.hash };
+    const std::int64_t start { event.data.start };
+    auto& stream { m_streams[hash] };
+
+    // events of one station mostly arrive in order, so the insert position is searched from the back
+    auto it { stream.end() };
+    while ((it != stream.begin()) && (std::prev(it)->data.start > start)) {
+        --it;
+    }
+    if (it == stream.begin()) {
+        m_heads.emplace(start, hash);
+    }
+    stream.insert(it, std::move(event));
+    m_buffered++;
+}
+
+template <typename Criterion>
+auto sweep_filter<Criterion>::process() -> int
+{
+    if (!m_recovered) {
+        recover();
+    }
+
+    advance();
+    sweep(m_watermark.current());
+
+    m_supervisor.set_queue_size(m_buffered + m_open.size());
+
+    const auto now { std::chrono::system_clock::now() };
+    if ((now - m_last_checkpoint) >= s_checkpoint_interval) {
+        m_last_checkpoint = now;
+        checkpoint();
+    }
+    return 0;
+}
+
+template <typename Criterion>
+auto sweep_filter<Criterion>::post_run() -> int
+{
+    if (m_checkpoint != nullptr) {
+        checkpoint();
+        return 0;
+    }
+    sweep(std::numeric_limits<std::int64_t>::max());
+    return 0;
+}
+
+template <typename Criterion>
+void sweep_filter<Criterion>::checkpoint()
+{
+    if (m_checkpoint == nullptr) {
+        return;
+    }
+    std::ostringstream stream {};
+    binary_writer out { stream };
+    for (const auto& event : m_open) {
+        out.write(s_record_open);
+        event_constructor::save_event(out, event);
+    }
+    for (const auto& [hash, events] : m_streams) {
+        for (const auto& event : events) {
+            out.write(s_record_buffered);
+            event_constructor::save_event(out, event);
+        }
+    }
+    const auto now { std::chrono::system_clock::now() };
+    if (!m_checkpoint->replace(std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count(), stream.str())) {
+        log::warning() << "Could not write sweep checkpoint.";
+    }
+}
+
+template <typename Criterion>
+void sweep_filter<Criterion>::recover()
+{
+    m_recovered = true;
+
+    const std::string& state { config::singleton()->files.state };
+    if (state.empty()) {
+        return;
+    }
+    m_checkpoint = std::make_unique<mapped_file>(state + ".sweep", s_checkpoint_magic);
+    if (!m_checkpoint->is_open()) {
+        m_checkpoint.reset();
+        return;
+    }
+
+    std::istringstream stream { std::string { m_checkpoint->content() } };
+    binary_reader in { stream };
+    std::size_t recovered { 0 };
+    std::uint8_t type {};
+    while (in.read(type)) {
+        event_t event {};
+        if (((type != s_record_open) && (type != s_record_buffered)) || !event_constructor::load_event(in, event)) {
+            log::warning() << "Sweep checkpoint is corrupt, recovering the records before the corruption.";
+            break;
+        }
+        if (type == s_record_open) {
+            m_open.emplace_back(std::move(event));
+        } else {
+            buffer(std::move(event));
+        }
+        recovered++;
+    }
+    if (recovered > 0) {
+        log::info() << "Recovered " << recovered << " buffered events and open coincidences from checkpoint.";
+    }
+}
+
+template <typename Criterion>
+auto sweep_filter<Criterion>::used_criterion() -> criterion&
+{
+    return m_criterion;
+}
+
+template <typename Criterion>
+void sweep_filter<Criterion>::sweep(std::int64_t watermark)
+{
+    // +++ merge the streams up to the watermark
+    std::vector<event_t> events {};
+    while (!m_heads.empty() && (m_heads.top().first <= watermark)) {
+        const auto [start, hash] { m_heads.top() };
+        m_heads.pop();
+
+        auto it { m_streams.find(hash) };
+        if ((it == m_streams.end()) || (it->second.front().data.start != start)) {
+            continue;
+        }
+        auto& stream { it->second };
+        events.emplace_back(std::move(stream.front()));
+        stream.pop_front();
+        m_buffered--;
+        if (stream.empty()) {
+            // stations come and go, so drained streams are not kept around
+            m_streams.erase(it);
+        } else {
+            m_heads.emplace(stream.front().data.start, hash);
+        }
+    }
+    // --- merge the streams up to the watermark
+
+    std::vector<slice_t> slices { slice(events, watermark) };
+    slices.front().open = std::move(m_open);
+
+    const snapshot_t snapshot { m_criterion.snapshot() };
+    if (slices.size() == 1) {
+        run(snapshot, events, slices.front());
+    } else {
+        m_pool->run(slices.size(), [&](std::size_t i) { run(snapshot, events, slices[i]); });
+    }
+
+    for (auto& current : slices) {
+        for (auto& event : current.finished) {
+            m_supervisor.increase_event_count(false, event.n());
+            put(std::move(event));
+        }
+    }
+    m_open = std::move(slices.back().open);
+}
+
+template <typename Criterion>
+auto sweep_filter<Criterion>::slice(const std::vector<event_t>& events, std::int64_t watermark) const -> std::vector<slice_t>
+{
+    std::vector<slice_t> slices {};
+    slices.emplace_back(slice_t { 0, events.size(), watermark });
+    if ((m_pool == nullptr) || (events.size() < (2 * s_minimum_slice))) {
+        return slices;
+    }
+
+    // events from other clusters can have constituents later than their start, so the latest constituent so far is tracked
+    std::int64_t latest { std::numeric_limits<std::int64_t>::min() };
+    for (const auto& event : m_open) {
+        latest = std::max(latest, constituents { event }.last());
+    }
+
+    const std::int64_t window { m_criterion.window() };
+    const std::size_t target { std::max(s_minimum_slice, events.size() / (4 * m_pool->size())) };
+    for (std::size_t i { 0 }; i < events.size(); i++) {
+        const std::int64_t previous { latest };
+        latest = std::max(latest, constituents { events[i] }.last());
+        if ((i - slices.back().begin) < target) {
+            continue;
+        }
+        if ((events[i].data.start - previous) <= window) {
+            continue;
+        }
+        // every coincidence open at the end of the previous slice is closed by the first event of the next one
+        slices.back().end = i;
+        slices.back().close = events[i].data.start;
+        slices.emplace_back(slice_t { i, events.size(), watermark });
+    }
+    return slices;
+}
+
+template <typename Criterion>
+void sweep_filter<Criterion>::run(const snapshot_t& snapshot, std::vector<event_t>& events, slice_t& slice) const
+{
+    for (std::size_t i { slice.begin }; i < slice.end; i++) {
+        close(slice.open, slice.finished, events[i].data.start);
+        match(snapshot, slice.open, std::move(events[i]));
+    }
+    close(slice.open, slice.finished, slice.close);
+}
+
+template <typename Criterion>
+void sweep_filter<Criterion>::match(const snapshot_t& snapshot, std::vector<event_t>& open, event_t event) const
+{
+    const constituents incoming { event };
+    const double maximum_false { m_criterion.maximum_false() };
+
+    std::vector<std::size_t> matches {};
+    for (std::size_t i { 0 }; i < open.size(); i++) {
+        if (shares_station(event, open[i])) {
+            continue;
+        }
+        if (maximum_false < m_criterion.apply(snapshot, incoming, constituents { open[i] })) {
+            matches.emplace_back(i);
+        }
+    }
+
+    if (matches.empty()) {
+        open.emplace_back(std::move(event));
+        return;
+    }
+
+    // Combines all contesting coincidences into the first one
+    event_t& target { open[matches.front()] };
+    combine(target, std::move(event));
+    for (auto it { matches.rbegin() }; it != std::prev(matches.rend()); ++it) {
+        target.emplace(std::move(open[*it]));
+        open.erase(open.begin() + static_cast<std::ptrdiff_t>(*it));
+    }
+}
+
+template <typename Criterion>
+void sweep_filter<Criterion>::close(std::vector<event_t>& open, std::vector<event_t>& finished, std::int64_t position) const
+{
+    const std::int64_t window { m_criterion.window() };
+    for (std::size_t i { open.size() }; i > 0; i--) {
+        event_t& event { open[i - 1] };
+        if ((position - constituents { event }.last()) <= window) {
+            continue;
+        }
+        finished.emplace_back(std::move(event));
+        open.erase(open.begin() + static_cast<std::ptrdiff_t>(i - 1));
+    }
+}
+
+}
+
+#endif // SWEEPFILTER_H
@@ -1,10 +1,9 @@
 #ifndef UPPERMATRIX_H
 #define UPPERMATRIX_H
 
+#include <algorithm>
 #include <cassert>
 #include <functional>
-#include <map>
-#include <unordered_map>
 #include <vector>
 
 namespace muonpi {
@@ -12,6 +11,7 @@ namespace muonpi {
 template <typename T>
 /**
  * @brief The upper_matrix class. Represents an upper triangle matrix in order to store all possible pairs of detector stations
+ * The elements are stored in one allocation per column, so growing the matrix never relocates existing elements.
  */
 class upper_matrix {
 public:
@@ -40,13 +40,15 @@ public:
 
     /**
      * @brief remove_index Removes a specific index from the matrix.
-     * Complexity should be O(n)
+     * The last index takes the place of the removed one, all other indices stay valid.
+     * Complexity is O(n), elements are moved, not copied.
      * @param index The index to remove
      */
     void remove_index(std::size_t index);
 
     /**
-     * @brief increase The number of elements by one
+     * @brief increase The number of elements by one.
+     * Adds a new column, existing elements are not relocated.
      * @return The index of the new element
      */
     auto increase() -> std::size_t;
@@ -63,66 +65,53 @@ public:
     void reset();
 
     /**
-     * @brief data Get a const reference to the underyling data.
+     * @brief for_each Calls a function for every element in the matrix
+     * @param function The function to call
      */
-    [[nodiscard]] auto data() -> std::vector<T>&;
+    void for_each(const std::function<void(T&)>& function);
 
-    [[nodiscard]] auto iterate(std::size_t index, std::function<void(T&)> function);
-
-private:
     /**
-     * @brief position Calculates the position in the vector for a given tuple
-     * @param x The x coordinate
-     * @param y The y coordinate
-     * @return The offset from the beginning of the vector
+     * @brief iterate Calls a function for every element associated with one index
+     * @param index The index
+     * @param function The function to call
      */
-    [[nodiscard]] inline auto position(std::size_t x, std::size_t y) const -> std::size_t
-    {
-        assert(x != y);
-        assert(x < m_columns);
-        assert(y < m_columns);
-
-        const std::size_t x_c { std::max(x, y) };
-        const std::size_t y_c { std::min(x, y) };
-
-        return (x_c * x_c - x_c) / 2 + y_c;
-    }
+    void iterate(std::size_t index, const std::function<void(T&)>& function);
 
     /**
-     * @brief iterator Get an iterator to the element at position x,y
-     * @param x the x coordinate
-     * @param y the y coordinate
-     * @return the iterator
+     * @brief size The number of indices
      */
-    [[nodiscard]] inline auto iterator(std::size_t x, std::size_t y) const
-    {
-        return m_elements.begin() + position(std::move(x), std::move(y));
-    }
+    [[nodiscard]] auto size() const -> std::size_t;
 
+private:
     std::size_t m_columns;
-    std::vector<T> m_elements;
+    std::vector<std::vector<T>> m_elements; //< column x holds the elements x,y for all y < x. Each column is allocated separately.
 };
 
 template <typename T>
 upper_matrix<T>::upper_matrix(std::size_t n)
-    : m_columns { n }
-    , m_elements { std::vector<T> { position(n, 0) } }
+    : m_columns { 0 }
+    , m_elements {}
 {
+    m_elements.reserve(n);
+    for (std::size_t i { 0 }; i < n; i++) {
+        increase();
+    }
 }
 
 template <typename T>
 auto upper_matrix<T>::at(std::size_t x, std::size_t y) -> T&
 {
-    return m_elements.at(position(x, y));
+    assert(x != y);
+    return m_elements.at(std::max(x, y)).at(std::min(x, y));
 }
 
 template <typename T>
 void upper_matrix<T>::emplace(std::size_t x, std::size_t y, T item)
 {
-    if (m_elements.empty()) {
+    if ((x == y) || (std::max(x, y) >= m_columns)) {
         return;
     }
-    m_elements[position(x, y)] = std::move(item);
+    m_elements[std::max(x, y)][std::min(x, y)] = std::move(item);
 }
 
 template <typename T>
@@ -131,49 +120,42 @@ void upper_matrix<T>::remove_index(std::size_t index)
     if (index >= m_columns) {
         return;
     }
-    // if the column is the last, it is enough to resize the vector to a size without the elements in the last column
-    if (index == (m_columns - 1)) {
-        m_columns--;
-        m_elements.resize(position(m_columns, 0));
-        return;
+    const std::size_t last { m_columns - 1 };
+    if (index < last) {
+        // the elements last,x for x > index belong into the columns after the removed index
+        for (std::size_t x { index + 1 }; x < last; x++) {
+            m_elements[x][index] = std::move(m_elements[last][x]);
+        }
+        // the elements last,y for y < index become the new column of the index
+        std::swap(m_elements[index], m_elements[last]);
+        m_elements[index].resize(index);
     }
-    // Swaps all elements for the index with the last column and resizes the vector.
-    // This will effectively delete the elements associated with the index.
-    swap_last(index);
+    m_elements.pop_back();
     m_columns--;
-    m_elements.resize(position(m_columns, 0));
-    if (index == (m_columns - 1)) {
-        return;
-    }
-    // Swap the elements back to its original location to keep integrity
-    swap_last(index);
 }
 
 template <typename T>
 auto upper_matrix<T>::increase() -> std::size_t
 {
+    m_elements.emplace_back(m_columns);
     m_columns++;
-    m_elements.resize(position(m_columns, 0));
     return m_columns - 1;
 }
 
 template <typename T>
 void upper_matrix<T>::swap_last(std::size_t first)
 {
-    if (first >= (m_columns - 1)) {
+    if ((m_columns == 0) || (first >= (m_columns - 1))) {
         return;
     }
+    const std::size_t last { m_columns - 1 };
 
     for (std::size_t y { 0 }; y < first; y++) {
-        T temp { at(first, y) };
-        at(first, y) = at(m_columns - 1, y);
-        at(m_columns - 1, y) = temp;
+        std::swap(m_elements[first][y], m_elements[last][y]);
     }
 
-    for (std::size_t x { first + 1 }; x < m_columns; x++) {
-        T temp { at(x, first) };
-        at(x, first) = at(m_columns - 1, x - 1);
-        at(m_columns - 1, x - 1) = temp;
+    for (std::size_t x { first + 1 }; x < last; x++) {
+        std::swap(m_elements[x][first], m_elements[last][x]);
     }
 }
 
@@ -185,21 +167,31 @@ void upper_matrix<T>::reset()
 }
 
 template <typename T>
-auto upper_matrix<T>::data() -> std::vector<T>&
+void upper_matrix<T>::for_each(const std::function<void(T&)>& function)
 {
-    return m_elements;
+    for (auto& column : m_elements) {
+        for (auto& element : column) {
+            function(element);
+        }
+    }
 }
 
 template <typename T>
-auto upper_matrix<T>::iterate(std::size_t index, std::function<void(T&)> function)
+void upper_matrix<T>::iterate(std::size_t index, const std::function<void(T&)>& function)
 {
     for (std::size_t y { 0 }; y < m_columns; y++) {
         if (y == index) {
             continue;
         }
-        function(m_elements.at(position(index, y)));
+        function(at(index, y));
     }
 }
 
+template <typename T>
+auto upper_matrix<T>::size() const -> std::size_t
+{
+    return m_columns;
+}
+
 }
 #endif // UPPERMATRIX_H
@@ -0,0 +1,58 @@
+#ifndef WATERMARK_H
+#define WATERMARK_H
+
+#include <chrono>
+#include <cinttypes>
+#include <unordered_map>
+
+namespace muonpi {
+
+/**
+ * @brief The watermark class
+ * Estimates up to which GNSS time all events have arrived.
+ * For every station the lag between the arrival of an event and its start timestamp is tracked
+ * with a smoothed mean and mean deviation. A station is expected to deliver its events within mean + 4 * deviation.
+ * The watermark is the current time minus the largest expected lag of all reliable stations. It never moves back.
+ */
+class watermark {
+public:
+    /**
+     * @brief arrived Records the arrival of an event
+     * @param hash The hash of the station
+     * @param start The start timestamp of the event, in ns since epoch
+     * @param now The arrival time, in ns since epoch
+     */
+    void arrived(std::uint64_t hash, std::int64_t start, std::int64_t now);
+
+    /**
+     * @brief advance Determines the watermark anew. Stations which did not send anything for a while are dropped.
+     * @param now The current time, in ns since epoch
+     * @param maximum The largest lag any station may hold the watermark back, in ns.
+     * Also used if there is no reliable station yet.
+     */
+    void advance(std::int64_t now, std::int64_t maximum);
+
+    /**
+     * @brief current The current watermark
+     * @return The point in time in ns since epoch up to which all events are expected to have arrived
+     */
+    [[nodiscard]] auto current() const -> std::int64_t;
+
+private:
+    struct station_t {
+        double mean {}; //< smoothed lag in ns
+        double deviation {}; //< smoothed mean deviation of the lag in ns
+        std::size_t n { 0 };
+        std::int64_t last { 0 }; //< last arrival in ns since epoch
+    };
+
+    static constexpr std::size_t s_minimum_samples { 8 };
+    static constexpr std::int64_t s_stale { std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::minutes { 10 }).count() };
+
+    std::unordered_map<std::uint64_t, station_t> m_stations {};
+    std::int64_t m_current { 0 };
+};
+
+}
+
+#endif // WATERMARK_H
@@ -17,12 +17,18 @@ struct cluster_log_t {
         double single_in { 0 }; //!< The mean rate of incoming events
         double l1_out { 0 }; //!< The mean rate of outgoing l1 events
     } frequency;
+    struct {
+        double median { 0 }; //!< The median delay between the start of an event and its arrival, in ms
+        double percentile { 0 }; //!< The percentile of the delay used as timebase, in ms
+    } delay;
 
     std::size_t incoming { 0 }; //!< The number of incoming messages in the last interval
+    std::size_t late { 0 }; //!< The number of incoming messages in the last interval which arrived after the watermark had passed them
     std::map<std::size_t, std::size_t> outgoing {}; //!< The number of outgoing messages in the last interval, separated by coincidence level
     std::size_t buffer_length { 0 }; //!< the current number of event constructors in the buffer
     std::size_t total_detectors { 0 }; //!< The current total number of tracked detectors
     std::size_t reliable_detectors { 0 }; //!< The current number of tracked detectors deemed reliable
+    std::size_t excluded_detectors { 0 }; //!< The current number of detectors excluded from the timebase because of their delay
     std::size_t maximum_n { 0 }; //!< The maximum coincidence level found so far since program start
     float process_cpu_load { 0.0 }; //!< The current cpu load in percent
     float system_cpu_load { 0.0 }; //!< The current cpu load in percent
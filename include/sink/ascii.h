@@ -86,11 +86,13 @@ void ascii<cluster_log_t>::get(cluster_log_t log)
         << "Cluster Log:"
         << "\n\ttimeout: " << log.timeout << " ms"
         << "\n\ttimebase: " << log.timebase << " ms"
+        << "\n\tdelay: " << log.delay.median << " ms median, " << log.delay.percentile << " ms percentile"
         << "\n\tuptime: " << log.uptime << " min"
         << "\n\tin: " << log.frequency.single_in << " Hz"
         << "\n\tout: " << log.frequency.l1_out << " Hz"
         << "\n\tbuffer: " << log.buffer_length
         << "\n\tevents in interval: " << log.incoming
+        << "\n\tlate events in interval: " << log.late
         << "\n\tcpu load: " << log.system_cpu_load
         << "\n\tprocess cpu load: " << log.process_cpu_load
         << "\n\tmemory usage: " << log.memory_usage
@@ -102,6 +104,7 @@ void ascii<cluster_log_t>::get(cluster_log_t log)
 
     out
         << "\n\tdetectors: " << log.total_detectors << "(" << log.reliable_detectors << ")"
+        << "\n\texcluded from timebase: " << log.excluded_detectors
         << "\n\tmaximum n: " << log.maximum_n << '\n';
 
     m_ostream << out.str() << std::flush;
@@ -61,17 +61,21 @@ void database<cluster_log_t>::get(cluster_log_t log)
         << tag { "cluster_id", config::singleton()->meta.station }
         << field { "timeout", log.timeout }
         << field { "timebase", log.timebase }
+        << field { "delay_median", log.delay.median }
+        << field { "delay_percentile", log.delay.percentile }
         << field { "uptime", log.uptime }
         << field { "frequency_in", log.frequency.single_in }
         << field { "frequency_l1_out", log.frequency.l1_out }
         << field { "buffer_length", log.buffer_length }
         << field { "total_detectors", log.total_detectors }
         << field { "reliable_detectors", log.reliable_detectors }
+        << field { "excluded_detectors", log.excluded_detectors }
         << field { "max_multiplicity", log.maximum_n }
         << field { "cpu_load", log.system_cpu_load }
         << field { "process_cpu_load", log.process_cpu_load }
         << field { "memory_usage", log.memory_usage }
-        << field { "incoming", log.incoming }) };
+        << field { "incoming", log.incoming }
+        << field { "late", log.late }) };
 
     std::size_t total_n { 0 };
 
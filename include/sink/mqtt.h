@@ -103,17 +103,21 @@ void mqtt<cluster_log_t>::get(cluster_log_t log)
     if (!(
             m_link.publish((construct(stream.str(), "timeout") << log.timeout).str())
             && m_link.publish((construct(stream.str(), "timebase") << log.timebase).str())
+            && m_link.publish((construct(stream.str(), "delay_median") << log.delay.median).str())
+            && m_link.publish((construct(stream.str(), "delay_percentile") << log.delay.percentile).str())
             && m_link.publish((construct(stream.str(), "uptime") << log.uptime).str())
             && m_link.publish((construct(stream.str(), "frequency_in") << log.frequency.single_in).str())
             && m_link.publish((construct(stream.str(), "frequency_l1_out") << log.frequency.l1_out).str())
             && m_link.publish((construct(stream.str(), "buffer_length") << log.buffer_length).str())
             && m_link.publish((construct(stream.str(), "total_detectors") << log.total_detectors).str())
             && m_link.publish((construct(stream.str(), "reliable_detectors") << log.reliable_detectors).str())
+            && m_link.publish((construct(stream.str(), "excluded_detectors") << log.excluded_detectors).str())
             && m_link.publish((construct(stream.str(), "max_coincidences") << log.maximum_n).str())
             && m_link.publish((construct(stream.str(), "cpu_load") << log.system_cpu_load).str())
             && m_link.publish((construct(stream.str(), "process_cpu_load") << log.process_cpu_load).str())
             && m_link.publish((construct(stream.str(), "memory_usage") << log.memory_usage).str())
-            && m_link.publish((construct(stream.str(), "incoming") << log.incoming).str()))) {
+            && m_link.publish((construct(stream.str(), "incoming") << log.incoming).str())
+            && m_link.publish((construct(stream.str(), "late") << log.late).str()))) {
         log::warning() << "Could not publish MQTT message.";
         return;
     }
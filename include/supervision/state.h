@@ -13,10 +13,13 @@
 
 #include "source/base.h"
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cinttypes>
 #include <fstream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 namespace muonpi::supervision {
@@ -38,6 +41,14 @@ public:
      */
     void time_status(std::chrono::milliseconds timebase, std::chrono::milliseconds timeout);
 
+    /**
+     * @brief delay_status Update the metrics of the delay between the start of an event and its arrival
+     * @param median The median delay in ms
+     * @param percentile The delay percentile used as timebase, in ms
+     * @param excluded The number of detectors excluded from the timebase because of their delay
+     */
+    void delay_status(double median, double percentile, std::size_t excluded);
+
     /**
      * @brief detector_status Update the status of one detector
      * @param hash The hashed detector identifier
@@ -45,6 +56,19 @@ public:
      */
     void on_detector_status(std::size_t hash, detector_status::status status);
 
+    /**
+     * @brief detectors The current number of detectors with a specific status. Safe to call from any thread.
+     * @param status The status to count
+     * @return The number of detectors
+     */
+    [[nodiscard]] auto detectors(detector_status::status status) const -> std::size_t;
+
+    /**
+     * @brief total_detectors The current number of tracked detectors. Safe to call from any thread.
+     * @return The number of detectors
+     */
+    [[nodiscard]] auto total_detectors() const -> std::size_t;
+
     /**
      * @brief increase_event_count gets called when an event arrives or gets processed
      * @param incoming true if the event is incoming, false if it a processed one
@@ -52,6 +76,11 @@ public:
      */
     void increase_event_count(bool incoming, std::size_t n = 1);
 
+    /**
+     * @brief increase_late_count gets called when an event arrives after the watermark has already passed it
+     */
+    void increase_late_count();
+
     /**
      * @brief set_queue_size Update the current event constructor buffer size.
      * @param size The current size
@@ -74,7 +103,11 @@ protected:
     [[nodiscard]] auto post_run() -> int override;
 
 private:
-    std::map<std::size_t, detector_status::status> m_detectors;
+    static constexpr std::size_t s_status_count { detector_status::reliable + 1 };
+
+    std::unordered_map<std::size_t, detector_status::status> m_detectors {};
+    std::array<std::atomic<std::size_t>, s_status_count> m_status_count {};
+    std::atomic<std::size_t> m_total_detectors { 0 };
     std::chrono::milliseconds m_timeout {};
     std::chrono::milliseconds m_timebase {};
     std::chrono::system_clock::time_point m_start { std::chrono::system_clock::now() };
@@ -6,14 +6,19 @@
 #include "source/base.h"
 
 #include "analysis/detectorstation.h"
+#include "analysis/detectortable.h"
 
 #include "messages/detectorinfo.h"
 #include "messages/event.h"
 #include "messages/trigger.h"
 
+#include "utility/deadlinequeue.h"
+
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <unordered_map>
 
 namespace muonpi {
 
@@ -80,14 +85,69 @@ protected:
 
     [[nodiscard]] auto process() -> int override;
 
+    /**
+     * @brief post_run Reimplemented from thread_runner. Writes a final snapshot of all detectors.
+     */
+    [[nodiscard]] auto post_run() -> int override;
+
 private:
+    /**
+     * @brief The maintenance struct. One scheduled maintenance task of a detector station.
+     */
+    struct maintenance {
+        enum class task {
+            log_interval,
+            rate,
+            summary
+        } type { task::log_interval };
+        std::size_t hash {};
+        std::uint64_t generation {}; //< distinguishes tasks of a detector from those of a deleted detector with the same hash
+    };
+
+    /**
+     * @brief schedule Schedules the initial maintenance tasks for a newly created detector
+     * @param hash The hashed detector identifier
+     */
+    void schedule(std::size_t hash);
+
+    /**
+     * @brief maintain Executes one due maintenance task and reschedules it if necessary
+     * @param now The current time
+     * @param task The task to execute
+     */
+    void maintain(const std::chrono::system_clock::time_point& now, maintenance task);
+
+    /**
+     * @brief checkpoint Writes a snapshot of all detector stations to the configured state file.
+     * The snapshot is written to a temporary file first, so an existing snapshot is only replaced by a complete one.
+     */
+    void checkpoint();
+
+    /**
+     * @brief restore Recreates the detector stations from the snapshot in the configured state file.
+     * Detectors whose last log message is older than the quit interval are discarded.
+     */
+    void restore();
+
+    static constexpr std::uint32_t s_snapshot_magic { 0x5453504d };
+    static constexpr std::uint16_t s_snapshot_version { 1 };
+    static constexpr std::chrono::system_clock::duration s_checkpoint_interval { std::chrono::minutes { 1 } };
+
     supervision::state& m_supervisor;
 
+    // the events arrive on a different thread than the detector logs, so the detectors and the table are only accessed with this mutex held
+    mutable std::mutex m_mutex {};
     std::map<std::size_t, std::unique_ptr<detector_station>> m_detectors {};
+    detector_table m_table {};
 
     std::queue<std::size_t> m_delete_detectors {};
 
-    std::chrono::steady_clock::time_point m_last { std::chrono::steady_clock::now() };
+    deadline_queue<maintenance> m_schedule {};
+    std::unordered_map<std::size_t, std::uint64_t> m_generations {};
+    std::uint64_t m_next_generation { 0 };
+
+    bool m_restored { false };
+    std::chrono::system_clock::time_point m_last_checkpoint { std::chrono::system_clock::now() };
 };
 
 }
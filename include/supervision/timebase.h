@@ -3,15 +3,28 @@
 
 #include "pipeline/base.h"
 
+#include "analysis/quantile.h"
 #include "messages/event.h"
 
 #include <chrono>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace muonpi::supervision {
 
+class state;
+
 /**
  * @brief The timebase_supervisor class
+ * Determines the timebase, how long to wait for the events of a coincidence.
+ * By default it is a percentile of the delay between the start of an event and its arrival.
+ * Detectors whose median delay is far above the median of the whole cluster are left out,
+ * so a single lagging detector does not increase the timeout for everyone.
+ *
+ * The events arrive on the thread of their source, the timebase is requested from the thread of the station supervisor.
+ * All statistics are therefore guarded by one mutex.
  */
 class timebase : public pipeline::base<event_t>, public pipeline::base<timebase_t> {
 public:
@@ -19,8 +32,10 @@ public:
      * @brief timebase
      * @param event_sink The event sink to use
      * @param timebase_sink the timebase sink to use
+     * @param supervisor The state supervisor to which the delay metrics are exported
+     * @param percentile The percentile of the delay to use, between 0 and 1. If 0, the spread of the event times is used instead.
      */
-    timebase(sink::base<event_t>& event_sink, sink::base<timebase_t>& timebase_sink);
+    timebase(sink::base<event_t>& event_sink, sink::base<timebase_t>& timebase_sink, state& supervisor, double percentile);
 
     /**
      * @brief get Reimplemented from pipeline::base
@@ -35,9 +50,30 @@ public:
     void get(timebase_t tb) override;
 
 private:
+    struct station_t {
+        p2_quantile median { 0.5 };
+        std::chrono::system_clock::time_point last {};
+    };
+
+    /**
+     * @brief update_delay Determines the timebase from the delay percentile and exports the metrics.
+     * At the end of each period the lagging detectors are determined anew and the estimates are restarted.
+     * Has to be called with m_mutex held.
+     * @param now The current time
+     */
+    void update_delay(std::chrono::system_clock::time_point now);
+
     static constexpr std::chrono::system_clock::duration s_minimum { std::chrono::milliseconds { 800 } };
+    static constexpr std::chrono::system_clock::duration s_minimum_delay { std::chrono::milliseconds { 100 } }; //< lower limit when using the delay percentile
     static constexpr std::chrono::system_clock::duration s_maximum { std::chrono::minutes { 2 } };
     static constexpr std::chrono::system_clock::duration s_sample_time { std::chrono::seconds { 2 } };
+    static constexpr std::chrono::system_clock::duration s_period { std::chrono::minutes { 5 } };
+    static constexpr std::size_t s_minimum_samples { 100 };
+    static constexpr std::size_t s_minimum_station_samples { 16 };
+    static constexpr double s_outlier_factor { 3.0 };
+
+    state& m_supervisor;
+    double m_percentile {};
 
     std::chrono::system_clock::time_point m_sample_start { std::chrono::system_clock::now() };
 
@@ -45,6 +81,14 @@ private:
     std::int_fast64_t m_end { std::numeric_limits<std::int_fast64_t>::min() };
 
     std::chrono::system_clock::duration m_current { s_minimum };
+
+    p2_quantile m_median { 0.5 }; //< median delay of all events in ms
+    p2_quantile m_delay { 0.5 }; //< delay percentile of the events from detectors which are not excluded, in ms
+    std::unordered_map<std::uint64_t, station_t> m_stations {};
+    std::unordered_set<std::uint64_t> m_excluded {};
+    std::chrono::system_clock::time_point m_period_start { std::chrono::system_clock::now() };
+
+    std::mutex m_mutex {};
 };
 
 }
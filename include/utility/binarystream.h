@@ -0,0 +1,155 @@
+#ifndef BINARYSTREAM_H
+#define BINARYSTREAM_H
+
+#include <array>
+#include <cinttypes>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+namespace muonpi {
+
+/**
+ * @brief The binary_writer class
+ * Writes arithmetic values and strings in their native binary representation to an output stream.
+ * The resulting data is only meant to be read on the same machine, e.g. for state snapshots.
+ */
+class binary_writer {
+public:
+    /**
+     * @brief binary_writer
+     * @param stream The stream to write to
+     */
+    explicit binary_writer(std::ostream& stream)
+        : m_stream { stream }
+    {
+    }
+
+    /**
+     * @brief write Writes one arithmetic or enum value
+     * @param value The value to write
+     */
+    template <typename T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value, bool> = true>
+    void write(T value)
+    {
+        m_stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /**
+     * @brief write Writes a string, prefixed with its length
+     * @param value The string to write
+     */
+    void write(const std::string& value)
+    {
+        write(static_cast<std::uint32_t>(value.size()));
+        m_stream.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
+
+    /**
+     * @brief write Writes all elements of an array of arithmetic values
+     * @param values The array to write
+     */
+    template <typename T, std::size_t N>
+    void write(const std::array<T, N>& values)
+    {
+        static_assert(std::is_arithmetic<T>::value);
+        m_stream.write(reinterpret_cast<const char*>(values.data()), sizeof(T) * N);
+    }
+
+    /**
+     * @brief good Checks the state of the underlying stream
+     * @return true if all writes were successful
+     */
+    [[nodiscard]] auto good() const -> bool
+    {
+        return m_stream.good();
+    }
+
+private:
+    std::ostream& m_stream;
+};
+
+/**
+ * @brief The binary_reader class
+ * Reads values written by a binary_writer.
+ */
+class binary_reader {
+public:
+    /**
+     * @brief binary_reader
+     * @param stream The stream to read from
+     */
+    explicit binary_reader(std::istream& stream)
+        : m_stream { stream }
+    {
+    }
+
+    /**
+     * @brief read Reads one arithmetic or enum value
+     * @param value The value to read into
+     * @return true if the read was successful
+     */
+    template <typename T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value, bool> = true>
+    auto read(T& value) -> bool
+    {
+        m_stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return m_stream.good();
+    }
+
+    /**
+     * @brief read Reads a length prefixed string
+     * @param value The string to read into
+     * @return true if the read was successful
+     */
+    auto read(std::string& value) -> bool
+    {
+        std::uint32_t size {};
+        if (!read(size)) {
+            return false;
+        }
+        value.resize(size);
+        m_stream.read(value.data(), static_cast<std::streamsize>(size));
+        return m_stream.good();
+    }
+
+    /**
+     * @brief read Reads all elements of an array of arithmetic values
+     * @param values The array to read into
+     * @return true if the read was successful
+     */
+    template <typename T, std::size_t N>
+    auto read(std::array<T, N>& values) -> bool
+    {
+        static_assert(std::is_arithmetic<T>::value);
+        m_stream.read(reinterpret_cast<char*>(values.data()), sizeof(T) * N);
+        return m_stream.good();
+    }
+
+    /**
+     * @brief skip Skips a number of bytes
+     * @param n The number of bytes to skip
+     * @return true if the stream is still valid
+     */
+    auto skip(std::size_t n) -> bool
+    {
+        m_stream.ignore(static_cast<std::streamsize>(n));
+        return m_stream.good();
+    }
+
+    /**
+     * @brief good Checks the state of the underlying stream
+     * @return true if all reads were successful
+     */
+    [[nodiscard]] auto good() const -> bool
+    {
+        return m_stream.good();
+    }
+
+private:
+    std::istream& m_stream;
+};
+
+}
+
+#endif // BINARYSTREAM_H
@@ -2,6 +2,8 @@
 #define COORDINATEMODEL_H
 
 #include <cmath>
+#include <cstddef>
+#include <vector>
 
 namespace muonpi::coordinate {
 
@@ -35,6 +37,36 @@ struct enu {
     double z { 0.0 };
 };
 
+/**
+ * @brief The ecef_array struct, many Ecef coordinates in structure of arrays layout.
+ * Used by the batch functions of transformation, the separate arrays allow the compiler to vectorise the loops.
+ */
+template <typename T>
+struct ecef_array {
+    std::vector<T> x {};
+    std::vector<T> y {};
+    std::vector<T> z {};
+
+    [[nodiscard]] auto size() const -> std::size_t
+    {
+        return x.size();
+    }
+
+    void resize(std::size_t n)
+    {
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+    }
+
+    void set(std::size_t i, const ecef<T>& coords)
+    {
+        x[i] = coords.x;
+        y[i] = coords.y;
+        z[i] = coords.z;
+    }
+};
+
 template <typename T>
 /**
  * @brief Implementes the WGS84 models for coordinate transformations
@@ -116,16 +148,53 @@ public:
      * @return
      */
     [[nodiscard]] static auto straight_distance(const geodetic<T>& first, const geodetic<T>& second) -> T;
+
+    /**
+     * @brief straight_distance Calculate the straight distance between two ecef coordinates
+     * @param first The first set of coordinates
+     * @param second The second set of coordinates
+     * @return
+     */
+    [[nodiscard]] static auto straight_distance(const ecef<T>& first, const ecef<T>& second) -> T;
+
+    /**
+     * @brief to_ecef converts many geodetic coordinates to the ecef reference system at once
+     * @param lat pointer to the latitudes
+     * @param lon pointer to the longitudes
+     * @param h pointer to the heights
+     * @param n The number of coordinates
+     * @return The Ecef coordinates
+     */
+    [[nodiscard]] static auto to_ecef(const T* lat, const T* lon, const T* h, std::size_t n) -> ecef_array<T>;
+
+    /**
+     * @brief straight_distances Calculate the straight distance between one point and a range of points
+     * @param points The points
+     * @param index The index of the point to measure from
+     * @param begin The index of the first point to measure to
+     * @param end One past the index of the last point to measure to
+     * @param distances pointer to the output array, receives end - begin distances
+     */
+    static void straight_distances(const ecef_array<T>& points, std::size_t index, std::size_t begin, std::size_t end, T* distances);
+
+    /**
+     * @brief distance_matrix Calculate the straight distances between all pairs of points
+     * @param points The points
+     * @return The distances in row major order, row x contains the distances to the points 0 to x-1
+     */
+    [[nodiscard]] static auto distance_matrix(const ecef_array<T>& points) -> std::vector<T>;
 };
 
 template <typename T, template <typename MT = T> typename Model>
 auto transformation<T, Model>::to_ecef(const geodetic<T>& coords) -> ecef<T>
 {
-    const T N { Model<T>::a / std::sqrt(1.0 - Model<T>::e_squared * std::pow(std::sin(coords.lat), 2.0)) };
+    const T sin_lat { std::sin(coords.lat) };
+    const T cos_lat { std::cos(coords.lat) };
+    const T N { Model<T>::a / std::sqrt(1.0 - Model<T>::e_squared * sin_lat * sin_lat) };
     return {
-        (N + coords.h) * std::cos(coords.lat) * std::cos(coords.lon),
-        (N + coords.h) * std::cos(coords.lat) * std::sin(coords.lon),
-        (N * std::pow(Model<T>::b, 2.0) / std::pow(Model<T>::a, 2.0) + coords.h) * std::sin(coords.lat)
+        (N + coords.h) * cos_lat * std::cos(coords.lon),
+        (N + coords.h) * cos_lat * std::sin(coords.lon),
+        (N * (Model<T>::b * Model<T>::b) / (Model<T>::a * Model<T>::a) + coords.h) * sin_lat
     };
 }
 
@@ -170,30 +239,85 @@ auto transformation<T, Model>::to_geodetic(const enu<T>& coords, const ecef<T>&
 template <typename T, template <typename MT = T> typename Model>
 auto transformation<T, Model>::to_geodetic(const ecef<T>& coords) -> geodetic<T>
 {
-    const double r { std::sqrt(std::pow(coords.x, 2.0) + std::pow(coords.y, 2.0)) };
-    const double e_squared { (std::pow(Model<T>::a, 2.0) - std::pow(Model<T>::b, 2.0)) / std::pow(Model<T>::b, 2.0) };
-    const double F { 54.0 * std::pow(Model<T>::b, 2.0) * std::pow(coords.z, 2.0) };
-    const double G { std::pow(r, 2.0) + (1.0 - Model<T>::e_squared) * std::pow(coords.z, 2.0) - Model<T>::e_squared * (std::pow(Model<T>::a, 2.0) - std::pow(Model<T>::b, 2.0)) };
-    const double c { std::pow(Model<T>::e_squared * r, 2.0) * F / std::pow(G, 3.0) };
-    const double s { std::pow(1.0 + c + std::sqrt(std::pow(c, 2.0) + 2.0 * c), 1.0 / 3.0) };
-    const double P { F / (3.0 * std::pow((s + 1.0 + 1.0 / s) * G, 2.0)) };
-    const double Q { std::sqrt(1.0 + 2.0 * std::pow(Model<T>::e_squared, 2.0) * P) };
-    const double r_0 { -P * Model<T>::e_squared * r / (1.0 + Q) + std::sqrt(0.5 * std::pow(Model<T>::a, 2.0) * (1.0 + 1.0 / Q) - P * (1.0 - Model<T>::e_squared) * std::pow(coords.z, 2.0) / (Q * (1.0 + Q)) - 0.5 * P * std::pow(r, 2.0)) };
-    const double U { std::sqrt(std::pow(r - Model<T>::e_squared * r_0, 2.0) + std::pow(coords.z, 2.0)) };
-    const double V { std::sqrt(std::pow(r - Model<T>::e_squared * r_0, 2.0) + (1.0 - Model<T>::e_squared) * std::pow(coords.z, 2.0)) };
-    const double z_0 { std::pow(Model<T>::b, 2.0) * coords.z / (Model<T>::a * V) };
+    constexpr double a_squared { Model<T>::a * Model<T>::a };
+    constexpr double b_squared { Model<T>::b * Model<T>::b };
+    constexpr double e_4 { Model<T>::e_squared * Model<T>::e_squared };
+    const double z_squared { coords.z * coords.z };
+    const double r_squared { coords.x * coords.x + coords.y * coords.y };
+    const double r { std::sqrt(r_squared) };
+    const double e_squared { (a_squared - b_squared) / b_squared };
+    const double F { 54.0 * b_squared * z_squared };
+    const double G { r_squared + (1.0 - Model<T>::e_squared) * z_squared - Model<T>::e_squared * (a_squared - b_squared) };
+    const double c { e_4 * r_squared * F / (G * G * G) };
+    const double s { std::cbrt(1.0 + c + std::sqrt(c * c + 2.0 * c)) };
+    const double k { (s + 1.0 + 1.0 / s) * G };
+    const double P { F / (3.0 * k * k) };
+    const double Q { std::sqrt(1.0 + 2.0 * e_4 * P) };
+    const double r_0 { -P * Model<T>::e_squared * r / (1.0 + Q) + std::sqrt(0.5 * a_squared * (1.0 + 1.0 / Q) - P * (1.0 - Model<T>::e_squared) * z_squared / (Q * (1.0 + Q)) - 0.5 * P * r_squared) };
+    const double d { r - Model<T>::e_squared * r_0 };
+    const double U { std::sqrt(d * d + z_squared) };
+    const double V { std::sqrt(d * d + (1.0 - Model<T>::e_squared) * z_squared) };
+    const double z_0 { b_squared * coords.z / (Model<T>::a * V) };
     return {
         std::atan((coords.z + e_squared * z_0) / r),
         std::atan2(coords.y, coords.x),
-        U * (1.0 - std::pow(Model<T>::b, 2.0) / (Model<T>::a * V))
+        U * (1.0 - b_squared / (Model<T>::a * V))
     };
 }
 
 template <typename T, template <typename MT = T> typename Model>
 auto transformation<T, Model>::straight_distance(const geodetic<T>& first, const geodetic<T>& second) -> T
 {
-    const auto second_enu { to_enu(second, to_ecef(first)) };
-    return std::sqrt(std::pow(second_enu.x, 2.0) + std::pow(second_enu.y, 2.0) + std::pow(second_enu.z, 2.0));
+    // the enu system is a rotation of the ecef system, so the distance can be taken in ecef directly
+    return straight_distance(to_ecef(first), to_ecef(second));
+}
+
+template <typename T, template <typename MT = T> typename Model>
+auto transformation<T, Model>::straight_distance(const ecef<T>& first, const ecef<T>& second) -> T
+{
+    const T d_x { first.x - second.x };
+    const T d_y { first.y - second.y };
+    const T d_z { first.z - second.z };
+    return std::sqrt(d_x * d_x + d_y * d_y + d_z * d_z);
+}
+
+template <typename T, template <typename MT = T> typename Model>
+auto transformation<T, Model>::to_ecef(const T* lat, const T* lon, const T* h, std::size_t n) -> ecef_array<T>
+{
+    ecef_array<T> result {};
+    result.resize(n);
+    for (std::size_t i { 0 }; i < n; i++) {
+        result.set(i, to_ecef(geodetic<T> { lat[i], lon[i], h[i] }));
+    }
+    return result;
+}
+
+template <typename T, template <typename MT = T> typename Model>
+void transformation<T, Model>::straight_distances(const ecef_array<T>& points, std::size_t index, std::size_t begin, std::size_t end, T* distances)
+{
+    const T x { points.x[index] };
+    const T y { points.y[index] };
+    const T z { points.z[index] };
+    const T* p_x { points.x.data() };
+    const T* p_y { points.y.data() };
+    const T* p_z { points.z.data() };
+    for (std::size_t i { begin }; i < end; i++) {
+        const T d_x { x - p_x[i] };
+        const T d_y { y - p_y[i] };
+        const T d_z { z - p_z[i] };
+        distances[i - begin] = std::sqrt(d_x * d_x + d_y * d_y + d_z * d_z);
+    }
+}
+
+template <typename T, template <typename MT = T> typename Model>
+auto transformation<T, Model>::distance_matrix(const ecef_array<T>& points) -> std::vector<T>
+{
+    const std::size_t n { points.size() };
+    std::vector<T> result((n * n - n) / 2);
+    for (std::size_t x { 1 }; x < n; x++) {
+        straight_distances(points, x, 0, x, result.data() + (x * x - x) / 2);
+    }
+    return result;
 }
 
 }
@@ -0,0 +1,120 @@
+#ifndef DEADLINEQUEUE_H
+#define DEADLINEQUEUE_H
+
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace muonpi {
+
+/**
+ * @brief The deadline_queue class
+ * Keeps items ordered by the time they are due. Only due items have to be touched when the queue is expired.
+ * @param T The type of the scheduled items
+ */
+template <typename T>
+class deadline_queue {
+public:
+    using time_point = std::chrono::system_clock::time_point;
+
+    /**
+     * @brief schedule Adds an item to the queue
+     * @param due The time point when the item is due
+     * @param item The item to schedule
+     */
+    void schedule(time_point due, T item);
+
+    /**
+     * @brief expire Removes all items which are due and calls function for each of them, in order of their deadline.
+     * Items scheduled from within function are handled in the same call if they are already due.
+     * @param now The current time
+     * @param function The function to call for every due item
+     * @return The number of items that were due
+     */
+    auto expire(time_point now, const std::function<void(time_point, T)>& function) -> std::size_t;
+
+    /**
+     * @brief size The number of currently scheduled items
+     */
+    [[nodiscard]] auto size() const -> std::size_t;
+
+    /**
+     * @brief empty true if there are no scheduled items
+     */
+    [[nodiscard]] auto empty() const -> bool;
+
+    /**
+     * @brief next The time point of the earliest scheduled item. Only valid if the queue is not empty.
+     */
+    [[nodiscard]] auto next() const -> time_point;
+
+    /**
+     * @brief clear Removes all scheduled items
+     */
+    void clear();
+
+private:
+    struct entry {
+        time_point due {};
+        T item {};
+
+        [[nodiscard]] inline auto operator>(const entry& other) const -> bool
+        {
+            return due > other.due;
+        }
+    };
+
+    std::priority_queue<entry, std::vector<entry>, std::greater<entry>> m_queue {};
+};
+
+// +++++++++++++++++++++++++++++++
+// implementation part starts here
+// +++++++++++++++++++++++++++++++
+
+template <typename T>
+void deadline_queue<T>::schedule(time_point due, T item)
+{
+    m_queue.push(entry { due, std::move(item) });
+}
+
+template <typename T>
+auto deadline_queue<T>::expire(time_point now, const std::function<void(time_point, T)>& function) -> std::size_t
+{
+    std::size_t n { 0 };
+    while (!m_queue.empty() && (m_queue.top().due <= now)) {
+        entry current { m_queue.top() };
+        m_queue.pop();
+        function(current.due, std::move(current.item));
+        n++;
+    }
+    return n;
+}
+
+template <typename T>
+auto deadline_queue<T>::size() const -> std::size_t
+{
+    return m_queue.size();
+}
+
+template <typename T>
+auto deadline_queue<T>::empty() const -> bool
+{
+    return m_queue.empty();
+}
+
+template <typename T>
+auto deadline_queue<T>::next() const -> time_point
+{
+    return m_queue.top().due;
+}
+
+template <typename T>
+void deadline_queue<T>::clear()
+{
+    m_queue = {};
+}
+
+}
+
+#endif // DEADLINEQUEUE_H
@@ -0,0 +1,107 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <array>
+#include <cinttypes>
+#include <string>
+#include <string_view>
+
+namespace muonpi {
+
+/**
+ * @brief The mapped_file class
+ * A memory mapped checkpoint file. It consists of a small header followed by the content.
+ * The header describes two regions of the file, each with an epoch time stamp, an offset and the number of valid bytes, and which of them is active.
+ * Appended data is only counted as valid once it has been completely copied into the mapping.
+ * A replacement is written outside of the active region and published by switching the active region with a single store,
+ * so a crash while writing leaves the previous content intact.
+ * Writes are synchronised to disk asynchronously by the kernel and never wait for the disk.
+ */
+class mapped_file {
+public:
+    /**
+     * @brief mapped_file Opens or creates a checkpoint file
+     * @param path The path of the file
+     * @param magic An identifier for the content type. Files with a different identifier get reinitialised.
+     */
+    mapped_file(std::string path, std::uint32_t magic);
+
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file(mapped_file&&) = delete;
+    auto operator=(const mapped_file&) -> mapped_file& = delete;
+    auto operator=(mapped_file&&) -> mapped_file& = delete;
+
+    /**
+     * @brief is_open Checks whether the file could be opened and mapped
+     */
+    [[nodiscard]] auto is_open() const -> bool;
+
+    /**
+     * @brief epoch The epoch time stamp stored in the header. 0 for a newly created file.
+     */
+    [[nodiscard]] auto epoch() const -> std::int64_t;
+
+    /**
+     * @brief content The currently valid content of the file
+     * @return A view into the mapping. Gets invalidated by append, replace and reset.
+     */
+    [[nodiscard]] auto content() const -> std::string_view;
+
+    /**
+     * @brief append Appends data to the valid content
+     * @param data The data to append
+     * @return false if the file could not be grown
+     */
+    auto append(std::string_view data) -> bool;
+
+    /**
+     * @brief replace Replaces the valid content. The previous content stays valid until the new one is completely written.
+     * @param epoch The new epoch time stamp
+     * @param data The new content
+     * @return false if the file could not be grown
+     */
+    auto replace(std::int64_t epoch, std::string_view data) -> bool;
+
+    /**
+     * @brief reset Discards the content and starts a new epoch
+     * @param epoch The new epoch time stamp
+     */
+    void reset(std::int64_t epoch);
+
+private:
+    struct region_t {
+        std::int64_t epoch {};
+        std::uint64_t offset {}; //< offset of the content from the start of the file
+        std::uint64_t used {}; //< number of valid bytes
+    };
+
+    struct header_t {
+        std::uint32_t magic {};
+        std::uint32_t format {};
+        std::uint32_t active {}; //< index of the region holding the valid content
+        std::uint32_t reserved {};
+        std::array<region_t, 2> regions {};
+    };
+
+    static constexpr std::size_t s_initial_size { 1 << 20 };
+    static constexpr std::uint32_t s_format { 2 }; //< layout of the header, files with a different layout get reinitialised
+
+    [[nodiscard]] auto map(std::size_t size) -> bool;
+    void unmap();
+    [[nodiscard]] auto reserve(std::size_t size) -> bool;
+    [[nodiscard]] auto header() const -> header_t;
+    void write_header(const header_t& header);
+    void write_region(std::uint32_t index, const region_t& region);
+    void activate(std::uint32_t index);
+
+    std::string m_path {};
+    int m_fd { -1 };
+    char* m_data { nullptr };
+    std::size_t m_size { 0 };
+};
+
+}
+
+#endif // MAPPEDFILE_H
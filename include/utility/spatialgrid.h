@@ -0,0 +1,74 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <cinttypes>
+#include <unordered_map>
+#include <vector>
+
+namespace muonpi {
+
+/**
+ * @brief The spatial_grid class
+ * Sorts points on the earth surface into cells of a latitude/longitude grid.
+ * The cells are at least as large as the search distance, so all points within that distance of a location
+ * can be found by looking at the neighbouring cells only.
+ */
+class spatial_grid {
+public:
+    /**
+     * @brief spatial_grid
+     * @param distance The search distance in meter. Determines the cell size.
+     */
+    explicit spatial_grid(double distance);
+
+    /**
+     * @brief insert Adds a point to the grid
+     * @param id An identifier of the point
+     * @param lat The latitude in degrees
+     * @param lon The longitude in degrees
+     */
+    void insert(std::size_t id, double lat, double lon);
+
+    /**
+     * @brief clear Removes all points
+     */
+    void clear();
+
+    /**
+     * @brief neighbours Gets all points which may be within the search distance of a location.
+     * The result may contain points which are further away, the exact distance has to be checked by the caller.
+     * @param lat The latitude in degrees
+     * @param lon The longitude in degrees
+     * @return The identifiers of all points in the surrounding cells
+     */
+    [[nodiscard]] auto neighbours(double lat, double lon) const -> std::vector<std::size_t>;
+
+    /**
+     * @brief cell Gets the cell of a location
+     * @param lat The latitude in degrees
+     * @param lon The longitude in degrees
+     * @return The key of the cell
+     */
+    [[nodiscard]] auto cell(double lat, double lon) const -> std::int64_t;
+
+    /**
+     * @brief neighbour_cells Gets all cells which may contain points within the search distance of any point in a cell, including the cell itself
+     * @param cell The key of the cell
+     * @return The keys of the neighbouring cells
+     */
+    [[nodiscard]] auto neighbour_cells(std::int64_t cell) const -> std::vector<std::int64_t>;
+
+private:
+    [[nodiscard]] auto row(double lat) const -> std::int64_t;
+    [[nodiscard]] auto column(double lon) const -> std::int64_t;
+    [[nodiscard]] auto key(std::int64_t row, std::int64_t column) const -> std::int64_t;
+
+    double m_cell_size {}; //< size of a cell in degrees
+    std::int64_t m_rows {};
+    std::int64_t m_columns {};
+    std::unordered_map<std::int64_t, std::vector<std::size_t>> m_cells {};
+};
+
+}
+
+#endif // SPATIALGRID_H
@@ -0,0 +1,69 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace muonpi {
+
+/**
+ * @brief The worker_pool class
+ * A fixed set of threads which run the tasks of one batch at a time.
+ * The thread which starts a batch works on it as well.
+ */
+class worker_pool {
+public:
+    /**
+     * @brief worker_pool
+     * @param threads The total number of threads working on a batch, including the calling thread
+     */
+    explicit worker_pool(std::size_t threads);
+
+    /**
+     * @brief ~worker_pool Stops and joins all threads
+     */
+    ~worker_pool();
+
+    worker_pool(const worker_pool&) = delete;
+    worker_pool(worker_pool&&) = delete;
+    auto operator=(const worker_pool&) -> worker_pool& = delete;
+    auto operator=(worker_pool&&) -> worker_pool& = delete;
+
+    /**
+     * @brief run Runs a task for every index in [0, count) and waits until all of them are done
+     * @param count The number of tasks
+     * @param task The function to call with the index of the task
+     */
+    void run(std::size_t count, const std::function<void(std::size_t)>& task);
+
+    /**
+     * @brief size The total number of threads working on a batch, including the calling thread
+     */
+    [[nodiscard]] auto size() const -> std::size_t;
+
+private:
+    void work();
+    void drain();
+
+    std::vector<std::thread> m_threads {};
+
+    std::mutex m_mutex {};
+    std::condition_variable m_start {};
+    std::condition_variable m_done {};
+
+    const std::function<void(std::size_t)>* m_task { nullptr };
+    std::size_t m_count { 0 };
+    std::atomic<std::size_t> m_next { 0 };
+    std::size_t m_active { 0 };
+    std::size_t m_generation { 0 };
+    bool m_quit { false };
+};
+
+}
+
+#endif // WORKERPOOL_H
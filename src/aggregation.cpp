@@ -1,24 +1,153 @@
+#include "analysis/histogramarchive.h"
+
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
-#include <iterator>
 #include <map>
-#include <sstream>
+#include <mutex>
+#include <set>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief The mapped_input class. Maps a text file read only into memory.
+ */
+class mapped_input {
+public:
+    explicit mapped_input(const std::string& path);
+    ~mapped_input();
+
+    mapped_input(const mapped_input&) = delete;
+    mapped_input(mapped_input&&) = delete;
+    auto operator=(const mapped_input&) -> mapped_input& = delete;
+    auto operator=(mapped_input&&) -> mapped_input& = delete;
+
+    [[nodiscard]] auto content() const -> std::string_view;
+
+private:
+    const char* m_data { nullptr };
+    std::size_t m_size { 0 };
+};
+
+/**
+ * @brief The line_parser class. Splits a text buffer into lines and whitespace separated fields without copying.
+ */
+class line_parser {
+public:
+    explicit line_parser(std::string_view data);
+
+    /**
+     * @brief next Advances to the next line
+     * @return false if there are no more lines
+     */
+    [[nodiscard]] auto next() -> bool;
+
+    /**
+     * @brief field Gets the next field of the current line
+     * @return The field. Empty if the line has no more fields.
+     */
+    [[nodiscard]] auto field() -> std::string_view;
+
+    /**
+     * @brief integer Parses the next field of the current line as an integer
+     * @param value The parsed value
+     * @return false if the field is missing or not a number
+     */
+    template <typename T>
+    [[nodiscard]] auto integer(T& value) -> bool;
+
+private:
+    std::string_view m_data {};
+    std::string_view m_line {};
+};
+
 class aggregator {
 public:
     explicit aggregator(std::string directory);
 
+    /**
+     * @brief find_files Collects the sample files in the directory which are not contained in the aggregate yet
+     * @return false if the directory could not be read
+     */
     [[nodiscard]] auto find_files() -> bool;
+
+    /**
+     * @brief has_input
+     * @return true if find_files found sample files to add
+     */
+    [[nodiscard]] auto has_input() const -> bool;
+
     [[nodiscard]] auto directory() const -> const std::string&;
+
+    /**
+     * @brief save Writes the aggregate together with the list of inputs it contains.
+     * The meta data is renamed into place last, which commits the histogram and the input list at once.
+     * @param filename The name of the aggregate without extension
+     * @return true if the aggregate was written
+     */
     [[nodiscard]] auto save(std::string_view filename = "aggregate") -> bool;
 
     void fill();
 
+    /**
+     * @brief load Adds the content of an existing aggregate, so new data can be folded into it
+     * @param filename The name of the aggregate without extension
+     */
+    void load(std::string_view filename = "aggregate");
+
+    /**
+     * @brief run The id of the last archive run stored in this aggregate. 0 if there was none.
+     */
+    [[nodiscard]] auto run() const -> std::uint64_t;
+
+    /**
+     * @brief set_run Sets the id of the archive run the aggregate gets saved for
+     * @param run The id of the run
+     */
+    void set_run(std::uint64_t run);
+
+    /**
+     * @brief add Adds the histogram of one station pair from a histogram archive
+     * @param archive The archive to read from
+     * @param pair The pair to add
+     * @return false if the histogram data is corrupt
+     */
+    [[nodiscard]] auto add(const muonpi::archive::reader& archive, const muonpi::archive::pair_t& pair) -> bool;
+
+    /**
+     * @brief merge Adds the data of another aggregator for the same pair
+     * @param other The aggregator to merge
+     */
+    void merge(const aggregator& other);
+
 private:
+    void read(const std::string& filename);
+
+    /**
+     * @brief complete Finishes or discards a save which was interrupted.
+     * If both temporary files are still present, the previous aggregate is intact and they are discarded.
+     * If only the meta data is left, the histogram was already committed and the meta data gets renamed as well.
+     * @param filename The name of the aggregate without extension
+     */
+    void complete(std::string_view filename = "aggregate") const;
+
+    /**
+     * @brief inputs Reads the sample files which are already contained in the aggregate
+     */
+    [[nodiscard]] auto inputs() const -> std::set<std::string>;
+
     std::map<std::int32_t, std::uint32_t> m_entries {};
     std::string m_directory {};
     double m_distance {};
@@ -26,12 +155,67 @@ private:
     std::uint32_t m_n {};
     std::uint32_t m_uptime {};
     std::uint32_t m_sample_time {};
+    std::uint64_t m_run {}; //< the last archive run contained in the aggregate
 
     std::vector<std::string> m_input_files {};
+    std::set<std::string> m_inputs {}; //< the sample files already contained in the aggregate
 };
 
 void print_help();
 
+/**
+ * @brief parallel_for Runs a function for every index in [0, count) on a pool of worker threads
+ * @param count The number of indices
+ * @param function The function to call with the index and the number of the worker
+ */
+void parallel_for(std::size_t count, const std::function<void(std::size_t, std::size_t)>& function);
+
+/**
+ * @brief worker_count The number of worker threads to use
+ */
+[[nodiscard]] auto worker_count() -> std::size_t;
+
+/**
+ * @brief read_list Reads a list of already processed inputs
+ * @param path The path of the list
+ * @return The set of inputs in the list
+ */
+[[nodiscard]] auto read_list(const std::string& path) -> std::set<std::string>;
+
+/**
+ * @brief write_list Writes a list of processed inputs. The list gets written under a temporary name and renamed once complete.
+ * @param path The path of the list
+ * @param list The inputs
+ * @return true if the list was written
+ */
+[[nodiscard]] auto write_list(const std::string& path, const std::set<std::string>& list) -> bool;
+
+/**
+ * @brief write_file Writes a file under a temporary name and renames it once it is complete
+ * @param path The path of the file
+ * @param content The content to write
+ * @return true if the file was written
+ */
+[[nodiscard]] auto write_file(const std::string& path, std::string_view content) -> bool;
+
+[[nodiscard]] auto aggregate_directories(const std::string& directory) -> bool;
+[[nodiscard]] auto aggregate_archives(const std::string& directory) -> bool;
+
+/**
+ * @brief aggregate_run Folds a set of histogram archives into the pair aggregates.
+ * Pairs which already contain the run are skipped, so an interrupted run can be repeated without counting anything twice.
+ * @param directory The top directory
+ * @param run The id of the run
+ * @param archives The archives of the run, relative to the top directory
+ * @return true if all pairs were saved
+ */
+[[nodiscard]] auto aggregate_run(const std::string& directory, std::uint64_t run, const std::vector<std::string>& archives) -> bool;
+
+constexpr std::string_view s_aggregate { "aggregate" };
+constexpr std::string_view s_input_list { "aggregate.inputs" }; //< per pair directory, the sample files already in the aggregate. Only read, newer versions keep them in the meta data.
+constexpr std::string_view s_archive_list { "aggregate.archives" }; //< in the top directory, the archives already in the aggregates
+constexpr std::string_view s_pending_list { "aggregate.pending" }; //< in the top directory, the id and the archives of a run which has not completed yet
+
 auto main(int argc, const char* argv[]) -> int
 {
     if (argc != 2) {
@@ -40,39 +224,357 @@ auto main(int argc, const char* argv[]) -> int
         return 1;
     }
 
-    std::string last_directory {};
-    for (const auto& p : std::filesystem::recursive_directory_iterator(argv[1])) {
-        if (!p.is_regular_file()) {
-            continue;
+    const auto start { std::chrono::steady_clock::now() };
+
+    if (!aggregate_directories(argv[1])) {
+        return 1;
+    }
+
+    if (!aggregate_archives(argv[1])) {
+        return 1;
+    }
+
+    std::cerr << "Aggregation took " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms using " << worker_count() << " threads.\n";
+    return 0;
+}
+
+auto aggregate_directories(const std::string& directory) -> bool
+{
+    std::set<std::string> directories {};
+    for (const auto& p : std::filesystem::recursive_directory_iterator(directory)) {
+        if (p.is_regular_file() && (p.path().extension() == ".hist")) {
+            directories.emplace(p.path().parent_path());
+        }
+    }
+    const std::vector<std::string> list { directories.begin(), directories.end() };
+
+    std::atomic<bool> success { true };
+    parallel_for(list.size(), [&](std::size_t i, std::size_t /*worker*/) {
+        aggregator agg { list[i] };
+
+        if (!agg.find_files()) {
+            success = false;
+            return;
+        }
+        // directories which contain only an aggregate, or no new sample files, are skipped
+        if (!agg.has_input()) {
+            return;
+        }
+
+        agg.load();
+        agg.fill();
+        if (!agg.save()) {
+            std::cerr << "Could not save data in '" << list[i] << "'.\n";
+            success = false;
+        }
+    });
+    return success;
+}
+
+auto aggregate_archives(const std::string& directory) -> bool
+{
+    const std::string pending_path { directory + "/" + std::string { s_pending_list } };
+
+    // +++ repeat a run which was interrupted before it could be recorded as complete
+    {
+        const std::set<std::string> pending { read_list(pending_path) };
+        if (!pending.empty()) {
+            std::uint64_t run {};
+            const std::string& id { *pending.begin() };
+            const auto [end, error] { std::from_chars(id.data() + 1, id.data() + id.size(), run) };
+            if ((id.front() != '#') || (error != std::errc {}) || (end != (id.data() + id.size()))) {
+                std::cerr << "Malformed list of pending archives '" << pending_path << "'\n";
+                return false;
+            }
+            if (!aggregate_run(directory, run, { std::next(pending.begin()), pending.end() })) {
+                return false;
+            }
         }
-        if (p.path().extension() != ".hist") {
+    }
+    // --- repeat a run which was interrupted
+
+    const std::set<std::string> processed { read_list(directory + "/" + std::string { s_archive_list }) };
+
+    std::set<std::string> archives {};
+    for (const auto& p : std::filesystem::recursive_directory_iterator(directory)) {
+        if (!p.is_regular_file() || (p.path().extension() != ".hists")) {
             continue;
         }
-        auto current_directory = p.path().parent_path();
-        if (last_directory == current_directory) {
+        std::string relative { std::filesystem::relative(p.path(), directory) };
+        if (processed.count(relative) > 0) {
             continue;
         }
+        archives.emplace(std::move(relative));
+    }
+    if (archives.empty()) {
+        return true;
+    }
 
-        aggregator agg { current_directory };
+    // the run gets recorded before any aggregate is touched. '#' sorts before any file name.
+    const std::uint64_t run { static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()) };
+    std::set<std::string> pending { archives };
+    pending.emplace("#" + std::to_string(run));
+    if (!write_list(pending_path, pending)) {
+        std::cerr << "Could not write the list of pending archives '" << pending_path << "'\n";
+        return false;
+    }
+    return aggregate_run(directory, run, { archives.begin(), archives.end() });
+}
 
-        if (!agg.find_files()) {
-            std::cerr << "Could not find any histograms in the specified directory '" << current_directory << "'\n";
-            return 1;
+auto aggregate_run(const std::string& directory, std::uint64_t run, const std::vector<std::string>& archives) -> bool
+{
+    // +++ every worker aggregates into its own set of pairs, they get merged afterwards
+    std::vector<std::map<std::string, aggregator>> partial { worker_count() };
+    std::vector<std::vector<std::string>> read { worker_count() };
+    parallel_for(archives.size(), [&](std::size_t i, std::size_t worker) {
+        const std::string path { directory + "/" + archives[i] };
+        muonpi::archive::reader archive {};
+        if (!archive.open(path)) {
+            std::cerr << "Could not read histogram archive '" << path << "'\n";
+            return;
         }
+        const auto& stations { archive.stations() };
 
-        agg.fill();
+        // an archive is only taken over as a whole, a corrupt one is left out completely and stays unprocessed
+        for (const auto& pair : archive.pairs()) {
+            if (!archive.for_each_bin(pair, [](std::uint32_t /*index*/, std::uint64_t /*count*/) {})) {
+                std::cerr << "Corrupt histogram data in '" << path << "', skipping the archive.\n";
+                return;
+            }
+        }
+
+        auto& aggregators { partial[worker] };
+        for (const auto& pair : archive.pairs()) {
+            const auto& first { stations.at(pair.first) };
+            const auto& second { stations.at(pair.second) };
+            std::string first_site { first.site_id };
+            std::string second_site { second.site_id };
+            std::replace(first_site.begin(), first_site.end(), '/', '-');
+            std::replace(second_site.begin(), second_site.end(), '/', '-');
+            const std::string name { (first.hash < second.hash) ? (first_site + "_" + second_site) : (second_site + "_" + first_site) };
+
+            auto& agg { aggregators.try_emplace(name, directory + "/" + name).first->second };
+            if (!agg.add(archive, pair)) {
+                std::cerr << "Corrupt histogram data for '" << name << "' in '" << path << "'\n";
+            }
+        }
+        read[worker].emplace_back(archives[i]);
+    });
+
+    std::map<std::string, aggregator> aggregators { std::move(partial.front()) };
+    for (std::size_t i { 1 }; i < partial.size(); i++) {
+        for (auto& [name, agg] : partial[i]) {
+            const auto [it, inserted] { aggregators.try_emplace(name, directory + "/" + name) };
+            it->second.merge(agg);
+        }
+        partial[i].clear();
+    }
+    // --- every worker aggregates into its own set of pairs, they get merged afterwards
+
+    std::vector<aggregator*> list {};
+    list.reserve(aggregators.size());
+    for (auto& [name, agg] : aggregators) {
+        list.emplace_back(&agg);
+    }
+
+    std::atomic<bool> success { true };
+    parallel_for(list.size(), [&](std::size_t i, std::size_t /*worker*/) {
+        auto& agg { *list[i] };
+        std::error_code error {};
+        std::filesystem::create_directories(agg.directory(), error);
+        if (error) {
+            std::cerr << "Could not create '" << agg.directory() << "': " << error.message() << '\n';
+            success = false;
+            return;
+        }
+        agg.load();
+        if (agg.run() == run) {
+            // saved before the run got interrupted
+            return;
+        }
+        agg.set_run(run);
         if (!agg.save()) {
-            std::cerr << "Could not save data.\n";
-            return 1;
+            std::cerr << "Could not save data in '" << agg.directory() << "'.\n";
+            success = false;
         }
+    });
+    if (!success) {
+        return false;
+    }
 
-        last_directory = current_directory;
+    const std::string list_path { directory + "/" + std::string { s_archive_list } };
+    std::set<std::string> processed { read_list(list_path) };
+    for (const auto& files : read) {
+        processed.insert(files.begin(), files.end());
+    }
+    if (!write_list(list_path, processed)) {
+        return false;
     }
+    std::error_code error {};
+    std::filesystem::remove(directory + "/" + std::string { s_pending_list }, error);
+    return !error;
 }
 
 void print_help()
 {
-    std::cerr << "aggregation searches a directory for histograms and aggregates them into a single histogram file.\nUsage: aggregation <directory>\n";
+    std::cerr << "aggregation searches a directory for histograms and histogram archives and aggregates them into a single histogram file per station pair.\n"
+                 "Inputs which were already aggregated are remembered in the 'aggregate.meta' and 'aggregate.archives' files and skipped on the next run.\n"
+                 "Usage: aggregation <directory>\n";
+}
+
+auto worker_count() -> std::size_t
+{
+    return std::max(1U, std::thread::hardware_concurrency());
+}
+
+void parallel_for(std::size_t count, const std::function<void(std::size_t, std::size_t)>& function)
+{
+    std::atomic<std::size_t> next { 0 };
+    const auto run { [&](std::size_t worker) {
+        for (std::size_t i { next++ }; i < count; i = next++) {
+            function(i, worker);
+        }
+    } };
+
+    std::vector<std::thread> workers {};
+    const std::size_t n { std::min(worker_count(), count) };
+    for (std::size_t worker { 1 }; worker < n; worker++) {
+        workers.emplace_back(run, worker);
+    }
+    run(0);
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+auto read_list(const std::string& path) -> std::set<std::string>
+{
+    std::set<std::string> list {};
+    std::ifstream file { path };
+    for (std::string line {}; std::getline(file, line);) {
+        if (!line.empty()) {
+            list.emplace(std::move(line));
+        }
+    }
+    return list;
+}
+
+auto write_list(const std::string& path, const std::set<std::string>& list) -> bool
+{
+    std::string content {};
+    for (const auto& entry : list) {
+        content += entry;
+        content += '\n';
+    }
+    return write_file(path, content);
+}
+
+auto write_file(const std::string& path, std::string_view content) -> bool
+{
+    const std::string temporary { path + ".tmp" };
+    {
+        std::ofstream file { temporary, std::ios::trunc };
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        if (!file.good()) {
+            return false;
+        }
+    }
+    std::error_code error {};
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+mapped_input::mapped_input(const std::string& path)
+{
+    const int fd { ::open(path.c_str(), O_RDONLY) };
+    if (fd < 0) {
+        return;
+    }
+    struct stat status { };
+    if ((fstat(fd, &status) != 0) || (status.st_size == 0)) {
+        ::close(fd);
+        return;
+    }
+    void* data { mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0) };
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return;
+    }
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<std::size_t>(status.st_size);
+}
+
+mapped_input::~mapped_input()
+{
+    if (m_data != nullptr) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+auto mapped_input::content() const -> std::string_view
+{
+    return { m_data, m_size };
+}
+
+line_parser::line_parser(std::string_view data)
+    : m_data { data }
+{
+}
+
+auto line_parser::next() -> bool
+{
+    if (m_data.empty()) {
+        return false;
+    }
+    const auto end { m_data.find('\n') };
+    m_line = m_data.substr(0, end);
+    m_data.remove_prefix((end == std::string_view::npos) ? m_data.size() : (end + 1));
+    return true;
+}
+
+auto line_parser::field() -> std::string_view
+{
+    const auto begin { m_line.find_first_not_of(" \t\r") };
+    if (begin == std::string_view::npos) {
+        m_line = {};
+        return {};
+    }
+    m_line.remove_prefix(begin);
+    const auto end { std::min(m_line.find_first_of(" \t\r"), m_line.size()) };
+    const std::string_view result { m_line.substr(0, end) };
+    m_line.remove_prefix(end);
+    return result;
+}
+
+template <typename T>
+auto line_parser::integer(T& value) -> bool
+{
+    const std::string_view text { field() };
+    if (text.empty()) {
+        return false;
+    }
+    const bool negative { text.front() == '-' };
+    if (negative && !std::is_signed_v<T>) {
+        return false;
+    }
+    T result {};
+    std::size_t i { negative ? 1U : 0U };
+    if (i == text.size()) {
+        return false;
+    }
+    for (; i < text.size(); i++) {
+        const char c { text[i] };
+        if (c == '.') {
+            // fractional parts are cut off
+            break;
+        }
+        if ((c < '0') || (c > '9')) {
+            return false;
+        }
+        result = static_cast<T>(result * 10 + static_cast<T>(c - '0'));
+    }
+    value = negative ? static_cast<T>(-result) : result;
+    return true;
 }
 
 aggregator::aggregator(std::string directory)
@@ -82,20 +584,39 @@ aggregator::aggregator(std::string directory)
 
 auto aggregator::find_files() -> bool
 {
-    for (const auto& entry : std::filesystem::directory_iterator(m_directory)) {
-        if (!entry.is_regular_file()) {
+    complete();
+    const std::set<std::string> processed { inputs() };
+    // this runs on a worker thread, so filesystem errors are reported instead of thrown
+    std::error_code error {};
+    std::filesystem::directory_iterator it { m_directory, error };
+    for (; !error && (it != std::filesystem::directory_iterator {}); it.increment(error)) {
+        const auto& path { it->path() };
+        if (path.extension() != ".meta") {
             continue;
         }
-        const auto& path { entry.path() };
-        if (path.extension() != ".meta") {
+        // a file which vanished in the meantime is skipped
+        std::error_code status {};
+        if (!it->is_regular_file(status)) {
             continue;
         }
         const std::string stem { path.stem() };
-
-        if (!std::filesystem::exists(m_directory + "/" + stem + ".hist")) {
+        if ((stem == s_aggregate) || (processed.count(stem) > 0)) {
+            continue;
+        }
+        if (!std::filesystem::exists(m_directory + "/" + stem + ".hist", status)) {
+            continue;
         }
         m_input_files.emplace_back(stem);
     }
+    if (error) {
+        std::cerr << "Could not read '" << m_directory << "': " << error.message() << '\n';
+        return false;
+    }
+    return true;
+}
+
+auto aggregator::has_input() const -> bool
+{
     return !m_input_files.empty();
 }
 
@@ -107,79 +628,201 @@ auto aggregator::directory() const -> const std::string&
 void aggregator::fill()
 {
     for (const auto& file : m_input_files) {
-        std::string filename { m_directory + "/" + file };
-        std::string filename_hist { filename + ".hist" };
-        std::string filename_meta { filename + ".meta" };
-        std::ifstream input_hist { filename_hist };
-
-        for (std::string line {}; std::getline(input_hist, line);) {
-            std::vector<std::string> cont {};
-            std::istringstream iss(line);
-            std::copy(std::istream_iterator<std::string> { iss },
-                std::istream_iterator<std::string> {},
-                std::back_inserter(cont));
-
-            if (cont.size() != 2) {
+        read(m_directory + "/" + file);
+    }
+}
+
+void aggregator::load(std::string_view filename)
+{
+    complete(filename);
+    const std::string name { m_directory + "/" + std::string { filename } };
+    std::error_code error {};
+    if (std::filesystem::exists(name + ".meta", error)) {
+        read(name);
+    }
+    if (filename == s_aggregate) {
+        m_inputs = inputs();
+    }
+}
+
+auto aggregator::run() const -> std::uint64_t
+{
+    return m_run;
+}
+
+void aggregator::set_run(std::uint64_t run)
+{
+    m_run = run;
+}
+
+void aggregator::complete(std::string_view filename) const
+{
+    const std::string name { m_directory + "/" + std::string { filename } };
+    const std::string hist_temporary { name + ".hist.tmp" };
+    const std::string meta_temporary { name + ".meta.tmp" };
+    std::error_code error {};
+    if (std::filesystem::exists(meta_temporary, error) && !std::filesystem::exists(hist_temporary, error)) {
+        std::filesystem::rename(meta_temporary, name + ".meta", error);
+        return;
+    }
+    std::filesystem::remove(hist_temporary, error);
+    std::filesystem::remove(meta_temporary, error);
+}
+
+auto aggregator::inputs() const -> std::set<std::string>
+{
+    std::set<std::string> list { read_list(m_directory + "/" + std::string { s_input_list }) };
+    const mapped_input input_meta { m_directory + "/" + std::string { s_aggregate } + ".meta" };
+    line_parser parser { input_meta.content() };
+    while (parser.next()) {
+        if (parser.field() != "input") {
+            continue;
+        }
+        const std::string_view value { parser.field() };
+        if (!value.empty()) {
+            list.emplace(value);
+        }
+    }
+    return list;
+}
+
+void aggregator::read(const std::string& filename)
+{
+    {
+        const mapped_input input_hist { filename + ".hist" };
+        line_parser parser { input_hist.content() };
+        while (parser.next()) {
+            std::int32_t bin {};
+            std::uint32_t count {};
+            if (!parser.integer(bin) || !parser.integer(count)) {
                 continue;
             }
-            std::int32_t bin { std::stoi(cont.at(0)) };
-            std::uint32_t count { static_cast<std::uint32_t>(std::stoul(cont.at(1))) };
-
             m_entries[bin] += count;
         }
-        input_hist.close();
-
-        std::ifstream input_meta { filename_meta };
-        for (std::string line {}; std::getline(input_meta, line);) {
-            std::vector<std::string> cont {};
-            std::istringstream iss(line);
-            std::copy(std::istream_iterator<std::string> { iss },
-                std::istream_iterator<std::string> {},
-                std::back_inserter(cont));
+    }
 
-            if (cont.size() != 3) {
-                continue;
+    const mapped_input input_meta { filename + ".meta" };
+    line_parser parser { input_meta.content() };
+    while (parser.next()) {
+        const std::string_view key { parser.field() };
+        if (key == "distance") {
+            const std::string_view value { parser.field() };
+            double distance {};
+            const auto [end, error] { std::from_chars(value.data(), value.data() + value.size(), distance) };
+            if ((error == std::errc {}) && (end == (value.data() + value.size()))) {
+                m_distance = distance;
             }
-            if (cont.at(0) == "distance") {
-                m_distance = std::stod(cont.at(1));
-            } else if (cont.at(0) == "total") {
-                m_n += std::stoul(cont.at(1));
-            } else if (cont.at(0) == "uptime") {
-                m_uptime += std::stoul(cont.at(1));
-            } else if (cont.at(0) == "bin_width") {
-                m_bin_width = std::stoul(cont.at(1));
-            } else if (cont.at(0) == "sample_time") {
-                m_sample_time += std::stoul(cont.at(1));
+            continue;
+        }
+        if (key == "run") {
+            std::uint64_t run {};
+            if (parser.integer(run)) {
+                m_run = run;
             }
+            continue;
+        }
+        std::uint32_t value {};
+        if (!parser.integer(value)) {
+            continue;
+        }
+        if (key == "total") {
+            m_n += value;
+        } else if (key == "uptime") {
+            m_uptime += value;
+        } else if (key == "bin_width") {
+            m_bin_width = value;
+        } else if (key == "sample_time") {
+            m_sample_time += value;
         }
-        input_meta.close();
     }
 }
 
-auto aggregator::save(std::string_view filename) -> bool
+auto aggregator::add(const muonpi::archive::reader& archive, const muonpi::archive::pair_t& pair) -> bool
 {
-    std::string name { m_directory + "/" + std::string { filename } };
-    std::string name_hist { name + ".hist" };
-    std::string name_meta { name + ".meta" };
-    if (std::filesystem::exists(name_hist)) {
-        std::filesystem::remove(name_hist);
+    const bool valid { archive.for_each_bin(pair, [&](std::uint32_t index, std::uint64_t count) {
+        const std::int32_t lower { pair.lower + static_cast<std::int32_t>(index) * pair.width };
+        m_entries[(lower + lower + pair.width) / 2] += static_cast<std::uint32_t>(count);
+    }) };
+    m_distance = pair.distance;
+    if (pair.size > 0) {
+        // pairs without histogram only contribute their total
+        m_bin_width = static_cast<std::uint32_t>(pair.width);
     }
-    if (std::filesystem::exists(name_meta)) {
-        std::filesystem::remove(name_meta);
+    m_n += static_cast<std::uint32_t>(pair.total);
+    m_uptime += static_cast<std::uint32_t>(pair.uptime);
+    m_sample_time += static_cast<std::uint32_t>((archive.end() - archive.start()) / 60000000000LL);
+    return valid;
+}
+
+void aggregator::merge(const aggregator& other)
+{
+    for (const auto& [bin, count] : other.m_entries) {
+        m_entries[bin] += count;
     }
-    std::ofstream output_hist { name_hist };
+    if (other.m_distance > 0.0) {
+        m_distance = other.m_distance;
+    }
+    if (other.m_bin_width > 0) {
+        m_bin_width = other.m_bin_width;
+    }
+    m_n += other.m_n;
+    m_uptime += other.m_uptime;
+    m_sample_time += other.m_sample_time;
+}
+
+auto aggregator::save(std::string_view filename) -> bool
+{
+    const std::string name { m_directory + "/" + std::string { filename } };
+    const std::string name_hist { name + ".hist" };
+    const std::string name_meta { name + ".meta" };
+
+    std::string hist {};
+    hist.reserve(m_entries.size() * 16);
     for (const auto& [bin, count] : m_entries) {
-        output_hist << std::to_string(bin) << ' ' << std::to_string(count) << '\n';
-    }
-    output_hist.close();
-    std::ofstream output_meta { name_meta };
-    output_meta
-        << "bin_width " << std::to_string(m_bin_width) << " ns\n"
-        << "distance " << std::to_string(m_distance) << " m\n"
-        << "total " << std::to_string(m_n) << " 1\n"
-        << "uptime " << std::to_string(m_uptime) << " min\n"
-        << "sample_time " << std::to_string(m_sample_time) << " min\n";
+        hist += std::to_string(bin);
+        hist += ' ';
+        hist += std::to_string(count);
+        hist += '\n';
+    }
+    std::string meta {
+        "bin_width " + std::to_string(m_bin_width) + " ns\n"
+        + "distance " + std::to_string(m_distance) + " m\n"
+        + "total " + std::to_string(m_n) + " 1\n"
+        + "uptime " + std::to_string(m_uptime) + " min\n"
+        + "sample_time " + std::to_string(m_sample_time) + " min\n"
+    };
+    if (m_run > 0) {
+        meta += "run " + std::to_string(m_run) + "\n";
+    }
+    m_inputs.insert(m_input_files.begin(), m_input_files.end());
+    for (const auto& input : m_inputs) {
+        meta += "input " + input + "\n";
+    }
+
+    // +++ write everything under temporary names first, so an interrupted run leaves the previous aggregate intact
+    // The meta data holds the list of inputs, renaming it commits the aggregate. @see aggregator::complete
+    const auto write { [](const std::string& path, const std::string& content) {
+        std::ofstream output { path + ".tmp", std::ios::trunc };
+        output.write(content.data(), static_cast<std::streamsize>(content.size()));
+        return output.good();
+    } };
+    if (!write(name_hist, hist) || !write(name_meta, meta)) {
+        return false;
+    }
+    std::error_code error {};
+    std::filesystem::rename(name_hist + ".tmp", name_hist, error);
+    if (!error) {
+        std::filesystem::rename(name_meta + ".tmp", name_meta, error);
+    }
+    if (error) {
+        return false;
+    }
+    // --- write everything under temporary names first
+
+    std::filesystem::remove(m_directory + "/" + std::string { s_input_list }, error);
+
+    static std::mutex output_mutex {};
+    std::scoped_lock<std::mutex> lock { output_mutex };
     std::cout << m_directory << ' ' << std::to_string(m_n) << ' ' << std::to_string(m_distance) << '\n';
-    output_meta.close();
     return true;
 }
@@ -2,55 +2,98 @@
 #include "messages/event.h"
 #include "utility/coordinatemodel.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include <chrono>
 
 namespace muonpi {
 
-coincidence::~coincidence() = default;
-
-auto coincidence::apply(const event_t& first, const event_t& second) const -> double
+coincidence::coincidence()
+    : m_geometry { std::make_shared<const geometry_t>() }
 {
-    std::vector<event_t::data_t> first_data {};
-    std::vector<event_t::data_t> second_data {};
+}
 
-    if (first.n() < 2) {
-        first_data.emplace_back(first.data);
-    } else {
-        first_data = first.events;
-    }
+coincidence::~coincidence() = default;
 
-    if (second.n() < 2) {
-        second_data.emplace_back(second.data);
-    } else {
-        second_data = second.events;
-    }
+auto coincidence::apply(const constituents& first, const constituents& second) const -> double
+{
+    return apply(snapshot(), first, second);
+}
 
+auto coincidence::apply(const snapshot_t& geometry, const constituents& first, const constituents& second) const -> double
+{
     double sum {};
 
-    for (const auto& data_f : first_data) {
-        for (const auto& data_s : second_data) {
-            sum += compare(data_f, data_s);
+    for (const auto& data_f : first) {
+        for (const auto& data_s : second) {
+            sum += compare(*geometry, data_f, data_s);
         }
     }
 
     return sum;
 }
 
-auto coincidence::compare(const event_t::data_t& first, const event_t::data_t& second) -> double
+auto coincidence::snapshot() const -> snapshot_t
+{
+    return std::atomic_load(&m_geometry);
+}
+
+auto coincidence::compare(const geometry_t& geometry, const event_t::data_t& first, const event_t::data_t& second) const -> double
 {
     const double delta { static_cast<double>(std::abs(first.start - second.start)) };
     if (delta > s_maximum_time) {
         return -1.0;
     }
-    const coordinate::geodetic<double> first_c { first.location.lat * units::degree, first.location.lon * units::degree, first.location.h * units::meter };
-    const coordinate::geodetic<double> second_c { second.location.lat * units::degree, second.location.lon * units::degree, second.location.h * units::meter };
-
-    const auto distance { coordinate::transformation<double, coordinate::WGS84>::straight_distance(first_c, second_c) };
+    const double distance { (first.hash == second.hash) ? 0.0 : coordinate::transformation<double, coordinate::WGS84>::straight_distance(position(geometry, first), position(geometry, second)) };
     const double time_of_flight { std::max(distance / consts::c_0, s_minimum_time) };
+    // stations further apart than the maximum distance are never coincident
+    if (time_of_flight > s_maximum_time) {
+        return -1.0;
+    }
 
     return std::max(1.0 - delta / time_of_flight, -1.0);
 }
 
+void coincidence::set_location(std::uint64_t hash, const location_t& location)
+{
+    const coordinate::ecef<double> position { to_ecef(location) };
+
+    std::scoped_lock<std::mutex> lock { m_mutex };
+    const std::shared_ptr<const geometry_t> current { std::atomic_load(&m_geometry) };
+    const auto it { current->find(hash) };
+    if ((it != current->end()) && (coordinate::transformation<double, coordinate::WGS84>::straight_distance(it->second, position) <= s_location_tolerance)) {
+        return;
+    }
+    auto next { std::make_shared<geometry_t>(*current) };
+    (*next)[hash] = position;
+    std::atomic_store(&m_geometry, std::shared_ptr<const geometry_t> { std::move(next) });
+}
+
+void coincidence::remove(std::uint64_t hash)
+{
+    std::scoped_lock<std::mutex> lock { m_mutex };
+    const std::shared_ptr<const geometry_t> current { std::atomic_load(&m_geometry) };
+    if (current->count(hash) == 0) {
+        return;
+    }
+    auto next { std::make_shared<geometry_t>(*current) };
+    next->erase(hash);
+    std::atomic_store(&m_geometry, std::shared_ptr<const geometry_t> { std::move(next) });
+}
+
+auto coincidence::position(const geometry_t& geometry, const event_t::data_t& data) -> coordinate::ecef<double>
+{
+    const auto it { geometry.find(data.hash) };
+    if (it != geometry.end()) {
+        return it->second;
+    }
+    return to_ecef(data.location);
+}
+
+auto coincidence::to_ecef(const location_t& location) -> coordinate::ecef<double>
+{
+    return coordinate::transformation<double, coordinate::WGS84>::to_ecef({ location.lat * units::degree, location.lon * units::degree, location.h * units::meter });
+}
+
 } // namespace muonpi
@@ -0,0 +1,63 @@
+#include "analysis/coincidenceengine.h"
+
+namespace muonpi {
+
+constexpr std::chrono::duration s_timeout { std::chrono::milliseconds { 100 } };
+
+coincidence_engine::coincidence_engine(sink::base<event_t>& event_sink, supervision::state& supervisor)
+    : sink::threaded<event_t> { "muon::filter", s_timeout }
+    , source::base<event_t> { event_sink }
+    , m_supervisor { supervisor }
+{
+}
+
+void coincidence_engine::get(timebase_t timebase)
+{
+    using namespace std::chrono;
+    m_timeout = milliseconds { static_cast<long>(static_cast<double>(duration_cast<milliseconds>(timebase.base).count()) * timebase.factor) };
+    m_supervisor.time_status(duration_cast<milliseconds>(timebase.base), duration_cast<milliseconds>(m_timeout));
+}
+
+void coincidence_engine::get(event_t event)
+{
+    threaded<event_t>::internal_get(event);
+}
+
+void coincidence_engine::get(detector_info_t<location_t> detector_info)
+{
+    used_criterion().set_location(detector_info.hash, detector_info.get<location_t>());
+}
+
+void coincidence_engine::get(trigger::detector trigger)
+{
+    if (trigger.status == detector_status::deleted) {
+        used_criterion().remove(trigger.hash);
+    }
+}
+
+void coincidence_engine::combine(event_t& target, event_t other)
+{
+    if (target.n() < 2) {
+        event_t e { target };
+        target.data.end = target.data.start;
+        target.emplace(e);
+    }
+    target.emplace(std::move(other));
+}
+
+void coincidence_engine::observe(const event_t& event)
+{
+    const auto now { std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() };
+    m_watermark.arrived(event.data.hash, event.data.start, now);
+    if (event.data.start < m_watermark.current()) {
+        m_supervisor.increase_late_count();
+    }
+}
+
+void coincidence_engine::advance()
+{
+    using namespace std::chrono;
+    m_watermark.advance(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count(), duration_cast<nanoseconds>(m_timeout).count());
+}
+
+} // namespace muonpi
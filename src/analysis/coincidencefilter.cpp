@@ -9,123 +9,508 @@
 #include "sink/base.h"
 #include "source/base.h"
 #include "supervision/timebase.h"
+#include "utility/binarystream.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <cmath>
+#include <limits>
+#include <sstream>
 
 namespace muonpi {
 
-constexpr std::chrono::duration s_timeout { std::chrono::milliseconds { 100 } };
-
-coincidence_filter::coincidence_filter(sink::base<event_t>& event_sink, supervision::state& supervisor)
-    : sink::threaded<event_t> { "muon::filter", s_timeout }
-    , source::base<event_t> { event_sink }
-    , m_supervisor { supervisor }
+coincidence_filter_base::coincidence_filter_base(sink::base<event_t>& event_sink, supervision::state& supervisor, std::size_t threads)
+    : coincidence_engine { event_sink, supervisor }
 {
+    if (threads > 1) {
+        m_pool = std::make_unique<worker_pool>(threads);
+    }
 }
 
-void coincidence_filter::get(timebase_t timebase)
-{
-    using namespace std::chrono;
-    m_timeout = milliseconds { static_cast<long>(static_cast<double>(duration_cast<milliseconds>(timebase.base).count()) * timebase.factor) };
-    m_supervisor.time_status(duration_cast<milliseconds>(timebase.base), duration_cast<milliseconds>(m_timeout));
-}
-
-void coincidence_filter::get(event_t event)
+auto coincidence_filter_base::process() -> int
 {
-    threaded<event_t>::internal_get(event);
-}
+    if (!m_recovered) {
+        recover();
+    }
 
-auto coincidence_filter::process() -> int
-{
     auto now { std::chrono::system_clock::now() };
 
+    advance();
+    const std::int64_t finished { m_watermark.current() - window() };
+    const bool checkpoint_due { (now - m_last_checkpoint) >= s_checkpoint_interval };
+
+    // +++ Match the batched events
+    // No constructor may be sent off before the events which arrived earlier are matched against it.
+    // Events arriving from now on are only matched against constructors which would not be finished here.
+    if (!m_batch.empty()) {
+        if (!checkpoint_due && (m_batch.size() < s_maximum_batch) && (m_batch_last >= finished)) {
+            m_finished = finished;
+            m_supervisor.set_queue_size(open_constructors() + m_batch.size());
+            return 0;
+        }
+        match_batch();
+    }
+    m_finished = finished;
+    // --- Match the batched events
+
     // +++ Send finished constructors off to the event sink
-    for (ssize_t i { static_cast<ssize_t>(m_constructors.size()) - 1 }; i >= 0; i--) {
-        auto& constructor { m_constructors[static_cast<std::size_t>(i)] };
+    // A constructor is finished once the watermark has passed its window. The timeout remains as a fallback.
+    for (std::size_t i { m_constructors.size() }; i > 0; i--) {
+        const std::size_t index { i - 1 };
+        if (!is_root(index)) {
+            continue;
+        }
+        auto& constructor { m_constructors[index] };
         constructor.set_timeout(m_timeout);
-        if (constructor.timed_out(now)) {
+        if ((m_ends[index] < finished) || constructor.timed_out(now)) {
+            consolidate(index);
             m_supervisor.increase_event_count(false, constructor.event.n());
-            put(constructor.event);
-            m_constructors.erase(m_constructors.begin() + i);
+            put(std::move(constructor.event));
+            release(index);
         }
     }
 
-    m_supervisor.set_queue_size(m_constructors.size());
+    m_supervisor.set_queue_size(open_constructors());
+
+    if (checkpoint_due) {
+        m_last_checkpoint = now;
+        checkpoint();
+    }
     return 0;
 }
 
-auto coincidence_filter::process(event_t event) -> int
+auto coincidence_filter_base::post_run() -> int
 {
-    m_supervisor.increase_event_count(true);
+    match_batch();
+    checkpoint();
+    return 0;
+}
 
-    std::queue<std::size_t> matches {};
+void coincidence_filter_base::enqueue(event_t event)
+{
+    m_batch_last = std::max(m_batch_last, constituents { event }.last());
+    m_batch.emplace_back(batched_t { std::move(event), m_finished });
+    m_supervisor.set_queue_size(open_constructors() + m_batch.size());
+}
+
+void coincidence_filter_base::match_batch()
+{
+    if (m_batch.empty()) {
+        return;
+    }
+    std::vector<component_t> parts { components() };
+    run(parts);
+    for (auto& part : parts) {
+        for (auto& constructor : part.open) {
+            add(std::move(constructor));
+        }
+    }
+    m_supervisor.set_queue_size(open_constructors());
+}
+
+auto coincidence_filter_base::components() -> std::vector<component_t>
+{
+    const std::int64_t window { this->window() };
+
+    // +++ Collect the time windows of the batched events and the open constructors
+    // an event reaches every constructor overlapping its window widened by the criterion window, the same interval select uses
+    struct interval_t {
+        std::int64_t lower {};
+        std::int64_t upper {};
+        std::size_t index {}; //< index into the batch or slot of the constructor
+        bool batched {};
+    };
+    std::vector<interval_t> intervals {};
+    intervals.reserve(m_batch.size());
+    for (std::size_t i { 0 }; i < m_batch.size(); i++) {
+        const constituents view { m_batch[i].event };
+        intervals.emplace_back(interval_t { view.start() - window, view.last() + window, i, true });
+    }
     for (std::size_t i { 0 }; i < m_constructors.size(); i++) {
-        auto& constructor { m_constructors[i] };
-        bool skip { false };
-        auto check_e_hash { [](const event_t::data_t& data, const event_t& e) {
-            if (e.n() < 2) {
-                return data.hash == e.data.hash;
+        if (is_root(i)) {
+            intervals.emplace_back(interval_t { m_starts[i], m_ends[i], i, false });
+        }
+    }
+    std::sort(intervals.begin(), intervals.end(), [](const interval_t& lhs, const interval_t& rhs) { return lhs.lower < rhs.lower; });
+    // --- Collect the time windows of the batched events and the open constructors
+
+    // +++ Join overlapping windows into components, and drop the ones without an event
+    std::vector<component_t> result {};
+    std::vector<std::size_t> events {};
+    std::vector<std::size_t> slots {};
+    const auto cut { [&] {
+        if (!events.empty()) {
+            component_t component {};
+            // the events have to be matched in the order of their arrival
+            std::sort(events.begin(), events.end());
+            for (const std::size_t index : events) {
+                component.events.emplace_back(std::move(m_batch[index]));
             }
-            return std::any_of(e.events.begin(), e.events.end(), [&](const event_t::data_t& d) { return d.hash == data.hash; });
-        } };
-        if (constructor.event.n() > 1) {
-            skip = std::any_of(constructor.event.events.begin(), constructor.event.events.end(), [&](const event_t::data_t& d) { return check_e_hash(d, event); });
-        } else if (event.n() > 1) {
-            skip = std::any_of(event.events.begin(), event.events.end(), [&](const event_t::data_t& d) { return check_e_hash(d, constructor.event); });
+            for (const std::size_t slot : slots) {
+                consolidate(slot);
+                component.open.emplace_back(std::move(m_constructors[slot]));
+                release(slot);
+            }
+            result.emplace_back(std::move(component));
+        }
+        events.clear();
+        slots.clear();
+    } };
+    std::int64_t upper { std::numeric_limits<std::int64_t>::min() };
+    for (const auto& interval : intervals) {
+        if (interval.lower > upper) {
+            cut();
+        }
+        upper = std::max(upper, interval.upper);
+        if (interval.batched) {
+            events.emplace_back(interval.index);
         } else {
-            if (constructor.event.data.hash == event.data.hash) {
-                skip = true;
+            slots.emplace_back(interval.index);
+        }
+    }
+    cut();
+    // --- Join overlapping windows into components, and drop the ones without an event
+
+    m_batch.clear();
+    m_batch_last = std::numeric_limits<std::int64_t>::min();
+    return result;
+}
+
+void coincidence_filter_base::checkpoint()
+{
+    if (m_checkpoint == nullptr) {
+        return;
+    }
+    const auto now { std::chrono::system_clock::now() };
+    const bool snapshot { m_snapshot_due || (m_checkpoint->content().size() > (s_compaction_factor * std::max(m_snapshot_size, s_minimum_snapshot))) };
+
+    std::ostringstream stream {};
+    binary_writer out { stream };
+    if (snapshot) {
+        for (std::size_t i { 0 }; i < m_constructors.size(); i++) {
+            if (is_root(i)) {
+                write_record(out, i);
             }
         }
-        if (skip) {
-            continue;
+        for (const std::size_t index : m_changes) {
+            m_touched[index] = 0;
+        }
+        m_changes.clear();
+    } else {
+        // consolidating a root frees its joined slots, which get appended to the list and written in the same pass
+        for (std::size_t i { 0 }; i < m_changes.size(); i++) {
+            write_record(out, m_changes[i]);
+            m_touched[m_changes[i]] = 0;
         }
-        if (m_criterion->maximum_false() < m_criterion->apply(event, constructor.event)) {
-            matches.push(i);
+        m_changes.clear();
+        if (stream.tellp() == 0) {
+            return;
         }
     }
-    m_supervisor.set_queue_size(m_constructors.size());
 
-    // +++ Event matches exactly one existing constructor
-    if (matches.size() == 1) {
-        event_constructor& constructor { m_constructors[matches.front()] };
-        matches.pop();
-        if (constructor.event.n() < 2) {
-            event_t e { constructor.event };
-            constructor.event.data.end = constructor.event.data.start;
-            constructor.event.emplace(e);
+    const std::string data { stream.str() };
+    bool written { false };
+    if (snapshot) {
+        written = m_checkpoint->replace(std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count(), data);
+        m_snapshot_size = data.size();
+        m_snapshot_due = !written;
+    } else {
+        written = m_checkpoint->append(data);
+        m_snapshot_due = !written;
+    }
+    if (!written) {
+        log::warning() << "Could not write coincidence checkpoint.";
+    }
+}
+
+void coincidence_filter_base::touch(std::size_t index)
+{
+    if (m_touched[index] != 0) {
+        return;
+    }
+    m_touched[index] = 1;
+    m_changes.emplace_back(index);
+}
+
+void coincidence_filter_base::write_record(binary_writer& out, std::size_t index)
+{
+    if (!is_root(index)) {
+        out.write(s_record_free);
+        out.write(static_cast<std::uint64_t>(index));
+        return;
+    }
+    consolidate(index);
+    out.write(s_record_store);
+    out.write(static_cast<std::uint64_t>(index));
+    m_constructors[index].save(out);
+}
+
+void coincidence_filter_base::recover()
+{
+    m_recovered = true;
+
+    const std::string& state { config::singleton()->files.state };
+    if (state.empty()) {
+        return;
+    }
+    m_checkpoint = std::make_unique<mapped_file>(state + ".constructors", s_checkpoint_magic);
+    if (!m_checkpoint->is_open()) {
+        m_checkpoint.reset();
+        return;
+    }
+
+    std::istringstream stream { std::string { m_checkpoint->content() } };
+    binary_reader in { stream };
+    std::map<std::uint64_t, event_constructor> constructors {};
+    std::uint8_t type {};
+    std::uint64_t slot {};
+    while (in.read(type) && in.read(slot)) {
+        if (type == s_record_free) {
+            constructors.erase(slot);
+            continue;
+        }
+        event_constructor constructor {};
+        if ((type != s_record_store) || !constructor.load(in)) {
+            log::warning() << "Coincidence checkpoint is corrupt, recovering the records before the corruption.";
+            break;
         }
-        constructor.event.emplace(std::move(event));
-        return 0;
+        constructors[slot] = std::move(constructor);
     }
-    // --- Event matches exactly one existing constructor
+    for (auto& [index, constructor] : constructors) {
+        add(std::move(constructor));
+    }
+    // the slots are numbered differently now, so the next checkpoint has to start with a new snapshot
+    m_snapshot_due = true;
+    if (!constructors.empty()) {
+        log::info() << "Recovered " << constructors.size() << " open coincidences from checkpoint.";
+    }
+}
 
-    // +++ Event matches either no, or more than one constructor
+void coincidence_filter_base::merge(event_t event, const std::vector<std::size_t>& matches)
+{
+    // +++ Event matches no constructor
     if (matches.empty()) {
         event_constructor constructor {};
-        constructor.event = event;
+        constructor.event = std::move(event);
         constructor.timeout = m_timeout;
-        m_constructors.emplace_back(std::move(constructor));
-        return 0;
-    }
-    event_constructor& constructor { m_constructors[matches.front()] };
-    matches.pop();
-    if (constructor.event.n() < 2) {
-        event_t e { constructor.event };
-        constructor.event.data.end = constructor.event.data.start;
-        constructor.event.emplace(e);
-    }
-    constructor.event.emplace(event);
-    // +++ Event matches more than one constructor
-    // Combines all contesting constructors into one contesting coincience
-    while (!matches.empty()) {
-        constructor.event.emplace(m_constructors[matches.front()].event);
-        m_constructors.erase(m_constructors.begin() + static_cast<ssize_t>(matches.front()));
-        matches.pop();
-    }
-    // --- Event matches more than one constructor
-    // --- Event matches either no, or more than one constructor
-    return 0;
+        add(std::move(constructor));
+        return;
+    }
+    // --- Event matches no constructor
+
+    // +++ Event matches one or more constructors
+    // All contesting constructors are joined to the first one, their constituents follow once the set is consolidated.
+    const std::size_t root { matches.front() };
+    m_stations[root] |= station_mask(event);
+    locate(root, event);
+    touch(root);
+    combine(m_constructors[root].event, std::move(event));
+    update_window(root);
+    for (auto it { std::next(matches.begin()) }; it != matches.end(); ++it) {
+        unite(root, *it);
+    }
+    // --- Event matches one or more constructors
+}
+
+void coincidence_filter_base::consolidate(std::size_t root)
+{
+    std::size_t member { m_next[root] };
+    while (member != root) {
+        const std::size_t next { m_next[member] };
+        locate(root, m_constructors[member].event);
+        m_constructors[root].event.emplace(std::move(m_constructors[member].event));
+        release(member);
+        member = next;
+    }
+    m_next[root] = root;
+}
+
+auto coincidence_filter_base::pending(std::size_t root) const -> bool
+{
+    return m_next[root] != root;
+}
+
+auto coincidence_filter_base::open_constructors() const -> std::size_t
+{
+    return m_constructors.size() - m_free.size();
+}
+
+void coincidence_filter_base::select(const event_t& event, std::int64_t lower, std::int64_t upper)
+{
+    m_candidates.clear();
+    if (m_grid == nullptr) {
+        prefilter(lower, upper);
+        for (std::size_t i { 0 }; i < m_overlaps.size(); i++) {
+            if (m_overlaps[i] != 0) {
+                m_candidates.emplace_back(i);
+            }
+        }
+        return;
+    }
+
+    std::vector<std::int64_t> cells {};
+    for (const auto& data : constituents { event }) {
+        const std::int64_t cell { m_grid->cell(data.location.lat, data.location.lon) };
+        if (std::find(cells.begin(), cells.end(), cell) == cells.end()) {
+            cells.emplace_back(cell);
+        }
+    }
+    for (const std::int64_t cell : cells) {
+        for (const std::int64_t neighbour : reachable(cell)) {
+            const auto it { m_buckets.find(neighbour) };
+            if (it == m_buckets.end()) {
+                continue;
+            }
+            auto& bucket { it->second };
+            for (std::size_t i { bucket.size() }; i > 0; i--) {
+                const auto [index, generation] { bucket[i - 1] };
+                if (generation != m_generations[index]) {
+                    bucket[i - 1] = bucket.back();
+                    bucket.pop_back();
+                    continue;
+                }
+                const std::size_t root { find(index) };
+                if ((m_starts[root] <= upper) && (m_ends[root] >= lower)) {
+                    m_candidates.emplace_back(root);
+                }
+            }
+        }
+    }
+    // the same order as without the grid, so the first match stays the same
+    std::sort(m_candidates.begin(), m_candidates.end());
+    m_candidates.erase(std::unique(m_candidates.begin(), m_candidates.end()), m_candidates.end());
+}
+
+void coincidence_filter_base::set_maximum_distance(double distance)
+{
+    if (!std::isfinite(distance)) {
+        m_grid.reset();
+        return;
+    }
+    m_grid = std::make_unique<spatial_grid>(distance);
+}
+
+void coincidence_filter_base::prefilter(std::int64_t lower, std::int64_t upper)
+{
+    const std::size_t n { m_starts.size() };
+    m_overlaps.resize(n);
+
+    // Kept free of branches and calls so it can be vectorised
+    const std::int64_t* starts { m_starts.data() };
+    const std::int64_t* ends { m_ends.data() };
+    std::uint8_t* overlaps { m_overlaps.data() };
+    for (std::size_t i { 0 }; i < n; i++) {
+        overlaps[i] = static_cast<std::uint8_t>((starts[i] <= upper) & (ends[i] >= lower));
+    }
+}
+
+void coincidence_filter_base::add(event_constructor constructor)
+{
+    const constituents view { constructor.event };
+    if (m_free.empty()) {
+        m_free.emplace_back(m_constructors.size());
+        m_constructors.emplace_back();
+        m_starts.emplace_back();
+        m_ends.emplace_back();
+        m_stations.emplace_back();
+        m_parents.emplace_back();
+        m_next.emplace_back();
+        m_cells.emplace_back();
+        m_generations.emplace_back();
+        m_touched.emplace_back(0);
+    }
+    const std::size_t index { m_free.back() };
+    m_free.pop_back();
+
+    m_starts[index] = view.start();
+    m_ends[index] = view.last();
+    m_stations[index] = station_mask(constructor.event);
+    m_parents[index] = index;
+    m_next[index] = index;
+    locate(index, constructor.event);
+    m_constructors[index] = std::move(constructor);
+    touch(index);
+}
+
+void coincidence_filter_base::release(std::size_t index)
+{
+    m_constructors[index] = event_constructor {};
+    m_starts[index] = std::numeric_limits<std::int64_t>::max();
+    m_ends[index] = std::numeric_limits<std::int64_t>::min();
+    m_stations[index] = 0;
+    m_parents[index] = s_free;
+    m_next[index] = index;
+    m_cells[index].clear();
+    m_generations[index]++;
+    m_free.emplace_back(index);
+    touch(index);
+}
+
+void coincidence_filter_base::unite(std::size_t root, std::size_t other)
+{
+    m_parents[other] = root;
+    // splices the two circular lists into one
+    std::swap(m_next[root], m_next[other]);
+
+    m_starts[root] = std::min(m_starts[root], m_starts[other]);
+    m_ends[root] = std::max(m_ends[root], m_ends[other]);
+    m_starts[other] = std::numeric_limits<std::int64_t>::max();
+    m_ends[other] = std::numeric_limits<std::int64_t>::min();
+    m_stations[root] |= m_stations[other];
+    m_stations[other] = 0;
+    touch(root);
+    touch(other);
+}
+
+void coincidence_filter_base::update_window(std::size_t index)
+{
+    const constituents view { m_constructors[index].event };
+    m_starts[index] = std::min(m_starts[index], view.start());
+    m_ends[index] = std::max(m_ends[index], view.last());
+}
+
+auto coincidence_filter_base::is_root(std::size_t index) const -> bool
+{
+    return m_parents[index] == index;
+}
+
+auto coincidence_filter_base::find(std::size_t index) -> std::size_t
+{
+    std::size_t root { index };
+    while (m_parents[root] != root) {
+        root = m_parents[root];
+    }
+    while (m_parents[index] != root) {
+        const std::size_t parent { m_parents[index] };
+        m_parents[index] = root;
+        index = parent;
+    }
+    return root;
+}
+
+void coincidence_filter_base::locate(std::size_t index, const event_t& event)
+{
+    if (m_grid == nullptr) {
+        return;
+    }
+    auto& cells { m_cells[index] };
+    for (const auto& data : constituents { event }) {
+        const std::int64_t cell { m_grid->cell(data.location.lat, data.location.lon) };
+        if (std::find(cells.begin(), cells.end(), cell) != cells.end()) {
+            continue;
+        }
+        cells.emplace_back(cell);
+        m_buckets[cell].emplace_back(index, m_generations[index]);
+    }
+}
+
+auto coincidence_filter_base::reachable(std::int64_t cell) -> const std::vector<std::int64_t>&
+{
+    auto it { m_reachable.find(cell) };
+    if (it == m_reachable.end()) {
+        it = m_reachable.emplace(cell, m_grid->neighbour_cells(cell)).first;
+    }
+    return it->second;
 }
 
 } // namespace muonpi
@@ -9,22 +9,23 @@
 
 namespace muonpi {
 
-constexpr double max_timing_error { 1000.0 * units::nanosecond }; //< max allowable timing error in nanoseconds
-constexpr double max_location_error { max_timing_error * consts::c_0 }; //< max allowable location error in meter
-constexpr double extreme_timing_error { max_timing_error * 100.0 };
-constexpr double stddev_factor { 0.75 };
-
 void detector_station::enable()
 {
     set_status(detector_status::created);
+    if (m_restored_status > detector_status::created) {
+        set_status(m_restored_status);
+    }
 }
 
-detector_station::detector_station(const detector_info_t<location_t>& initial_log, supervision::station& stationsupervisor)
+detector_station::detector_station(const detector_info_t<location_t>& initial_log, detector_table& table, supervision::station& stationsupervisor)
     : m_location { initial_log.get<location_t>() }
     , m_hash { initial_log.hash }
     , m_userinfo { initial_log.userinfo }
+    , m_table { table }
+    , m_row { table.emplace(initial_log.hash) }
     , m_stationsupervisor { stationsupervisor }
 {
+    m_table.set_location(m_row, m_location, std::chrono::system_clock::now());
 }
 
 auto detector_station::process(const event_t& event) -> bool
@@ -52,82 +53,84 @@ auto detector_station::process(const event_t& event) -> bool
     }
     m_time_acc.add(event.data.time_acc);
     m_reliability_time_acc.add(event.data.time_acc);
+    m_table.set_time_accuracy(m_row, m_reliability_time_acc.mean());
 
-    if (event.data.time_acc > (extreme_timing_error)) {
+    if (event.data.time_acc > (detector_table::s_extreme_timing_error)) {
         set_status(detector_status::unreliable, detector_status::reason::time_accuracy_extreme);
     }
 
-    return (event.data.time_acc <= max_timing_error) && (event.data.fix == 1);
+    return (event.data.time_acc <= detector_table::s_max_timing_error) && (event.data.fix == 1);
 }
 
 void detector_station::process(const detector_info_t<location_t>& info)
 {
-    m_last_log = std::chrono::system_clock::now();
     m_location = info.get<location_t>();
-    check_reliability();
+    m_table.set_location(m_row, m_location, std::chrono::system_clock::now());
 }
 
 void detector_station::set_status(detector_status::status status, detector_status::reason reason)
 {
-    if (m_status != status) {
+    if (m_table.status(m_row) != status) {
         m_stationsupervisor.on_detector_status(m_hash, status, reason);
     }
-    m_status = status;
+    m_table.set_status(m_row, status);
 }
 
 auto detector_station::is(detector_status::status status) const -> bool
 {
-    return m_status == status;
+    return m_table.status(m_row) == status;
 }
 
 auto detector_station::factor() const -> double
 {
-    return m_factor;
+    return m_table.factor(m_row);
 }
 
-void detector_station::check_reliability()
+auto detector_station::step(const std::chrono::system_clock::time_point& now) -> std::chrono::system_clock::time_point
 {
-    constexpr static double hysteresis { 0.15 };
-
-    const double loc_precision { m_location.dop * std::sqrt((m_location.h_acc * m_location.h_acc + m_location.v_acc * m_location.v_acc)) };
-    const double f_location { loc_precision / max_location_error };
-    const double f_time { m_reliability_time_acc.mean() / max_timing_error };
-    const double f_rate { m_mean_rate.stddev() / (m_mean_rate.mean() * stddev_factor) };
-
-    if (f_location > (1.0 + hysteresis)) {
-        set_status(detector_status::unreliable, detector_status::reason::location_precision);
-    } else if (f_time > (1.0 + hysteresis)) {
-        set_status(detector_status::unreliable, detector_status::reason::time_accuracy);
-    } else if (f_rate > (1.0 + hysteresis)) {
-        set_status(detector_status::unreliable, detector_status::reason::rate_unstable);
-    } else if ((f_location < (1.0 - hysteresis)) && (f_time < (1.0 - hysteresis)) && ((f_rate < (1.0 - hysteresis)))) {
-        set_status(detector_status::reliable);
+    if (m_current_rate.step(now)) {
+        m_mean_rate.step(now);
+        m_table.set_rates(m_row, m_current_rate.mean(), m_mean_rate.mean(), m_mean_rate.stddev());
     }
+    return m_current_rate.next_step();
 }
 
-void detector_station::step(const std::chrono::system_clock::time_point& now)
+void detector_station::save(binary_writer& out) const
 {
-    auto diff { now - std::chrono::system_clock::time_point { m_last_log } };
-    if (diff > s_log_interval) {
-        if (diff > s_quit_interval) {
-            set_status(detector_status::deleted, detector_status::reason::missed_log_interval);
-            return;
-        }
-        set_status(detector_status::unreliable, detector_status::reason::missed_log_interval);
+    out.write(static_cast<std::uint8_t>(m_table.status(m_row)));
+    m_current_rate.save(out);
+    m_mean_rate.save(out);
+    m_time_acc.save(out);
+    m_reliability_time_acc.save(out);
+}
 
-    } else {
-        check_reliability();
+auto detector_station::restore(binary_reader& in, std::chrono::system_clock::time_point last_log) -> bool
+{
+    std::uint8_t status {};
+    if (!in.read(status) || (status < detector_status::created) || (status > detector_status::reliable)) {
+        return false;
     }
+    if (!m_current_rate.load(in) || !m_mean_rate.load(in) || !m_time_acc.load(in) || !m_reliability_time_acc.load(in)) {
+        return false;
+    }
+    m_restored_status = static_cast<detector_status::status>(status);
 
-    if (m_current_rate.step(now)) {
-        m_mean_rate.step(now);
-        if (m_current_rate.mean() < (m_mean_rate.mean() - m_mean_rate.stddev())) {
-            constexpr static double scale { 2.0 };
-            m_factor = ((m_mean_rate.mean() - m_current_rate.mean()) / (m_mean_rate.stddev()) + 1.0) * scale;
-        } else {
-            m_factor = 1.0;
-        }
+    m_table.set_location(m_row, m_location, last_log);
+    m_table.set_time_accuracy(m_row, m_reliability_time_acc.mean());
+    if (m_mean_rate.entries() > 0) {
+        m_table.set_rates(m_row, m_current_rate.mean(), m_mean_rate.mean(), m_mean_rate.stddev());
     }
+    return true;
+}
+
+auto detector_station::row() const -> std::size_t
+{
+    return m_row;
+}
+
+void detector_station::set_row(std::size_t row)
+{
+    m_row = row;
 }
 
 auto detector_station::current_log_data() -> detector_summary_t
@@ -0,0 +1,240 @@
+#include "analysis/detectortable.h"
+
+#include <cmath>
+
+namespace muonpi {
+
+[[nodiscard]] static inline auto to_nanoseconds(const std::chrono::system_clock::time_point& time) -> std::int64_t
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+auto detector_table::emplace(std::size_t hash) -> std::size_t
+{
+    m_hash.emplace_back(hash);
+    m_current_rate.emplace_back(0.0);
+    m_mean_rate.emplace_back(0.0);
+    m_stddev_rate.emplace_back(0.0);
+    m_time_acc.emplace_back(0.0);
+    m_loc_precision.emplace_back(0.0);
+    m_factor.emplace_back(1.0);
+    m_last_log.emplace_back(to_nanoseconds(std::chrono::system_clock::now()));
+    m_log_flags.emplace_back(0);
+    m_status.emplace_back(detector_status::unreliable);
+    m_marked.emplace_back(0);
+    const std::size_t row { m_hash.size() - 1 };
+    mark(row);
+    return row;
+}
+
+auto detector_table::erase(std::size_t row) -> std::size_t
+{
+    const std::size_t last { m_hash.size() - 1 };
+    if ((m_status[row] == detector_status::reliable) && (m_factor[row] >= m_largest)) {
+        m_largest_valid = false;
+    }
+    if (row != last) {
+        m_hash[row] = m_hash[last];
+        m_current_rate[row] = m_current_rate[last];
+        m_mean_rate[row] = m_mean_rate[last];
+        m_stddev_rate[row] = m_stddev_rate[last];
+        m_time_acc[row] = m_time_acc[last];
+        m_loc_precision[row] = m_loc_precision[last];
+        m_factor[row] = m_factor[last];
+        m_last_log[row] = m_last_log[last];
+        m_log_flags[row] = m_log_flags[last];
+        m_status[row] = m_status[last];
+        if (m_marked[last] != 0) {
+            mark(row);
+        }
+    }
+    const std::size_t hash { m_hash[row] };
+    m_hash.pop_back();
+    m_current_rate.pop_back();
+    m_mean_rate.pop_back();
+    m_stddev_rate.pop_back();
+    m_time_acc.pop_back();
+    m_loc_precision.pop_back();
+    m_factor.pop_back();
+    m_last_log.pop_back();
+    m_log_flags.pop_back();
+    m_status.pop_back();
+    m_marked.pop_back();
+    return hash;
+}
+
+auto detector_table::size() const -> std::size_t
+{
+    return m_hash.size();
+}
+
+auto detector_table::hash(std::size_t row) const -> std::size_t
+{
+    return m_hash[row];
+}
+
+auto detector_table::status(std::size_t row) const -> detector_status::status
+{
+    return static_cast<detector_status::status>(m_status[row]);
+}
+
+auto detector_table::factor(std::size_t row) const -> double
+{
+    return m_factor[row];
+}
+
+auto detector_table::last_log(std::size_t row) const -> std::chrono::system_clock::time_point
+{
+    return std::chrono::system_clock::time_point { std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds { m_last_log[row] }) };
+}
+
+void detector_table::set_status(std::size_t row, detector_status::status status)
+{
+    if ((m_status[row] == detector_status::reliable) && (status != detector_status::reliable) && (m_factor[row] >= m_largest)) {
+        m_largest_valid = false;
+    }
+    m_status[row] = static_cast<std::uint8_t>(status);
+    mark(row);
+}
+
+void detector_table::set_rates(std::size_t row, double current, double mean, double stddev)
+{
+    m_current_rate[row] = current;
+    m_mean_rate[row] = mean;
+    m_stddev_rate[row] = stddev;
+    mark(row);
+}
+
+void detector_table::set_time_accuracy(std::size_t row, double time_acc)
+{
+    m_time_acc[row] = time_acc;
+    mark(row);
+}
+
+void detector_table::set_location(std::size_t row, const location_t& location, std::chrono::system_clock::time_point time)
+{
+    m_loc_precision[row] = location.dop * std::sqrt((location.h_acc * location.h_acc + location.v_acc * location.v_acc));
+    m_last_log[row] = to_nanoseconds(time);
+    m_log_flags[row] = 0;
+    mark(row);
+}
+
+auto detector_table::check_log(std::size_t row, const std::chrono::system_clock::time_point& now) -> std::chrono::system_clock::time_point
+{
+    const std::chrono::system_clock::time_point last { last_log(row) };
+    const auto diff { now - last };
+    mark(row);
+    if (diff > s_quit_interval) {
+        m_log_flags[row] = s_flag_missed_log | s_flag_quit;
+        return std::chrono::system_clock::time_point::max();
+    }
+    if (diff > s_log_interval) {
+        m_log_flags[row] = s_flag_missed_log;
+        return last + s_quit_interval + std::chrono::milliseconds { 1 };
+    }
+    m_log_flags[row] = 0;
+    return last + s_log_interval + std::chrono::milliseconds { 1 };
+}
+
+auto detector_table::step(const std::function<void(std::size_t, detector_status::status, detector_status::reason)>& on_change) -> double
+{
+    constexpr double upper { 1.0 + s_hysteresis };
+    constexpr double lower { 1.0 - s_hysteresis };
+    constexpr double scale { 2.0 };
+
+    const std::size_t rows { m_hash.size() };
+
+    // +++ evaluate the dirty rows
+    // rows marked while the callbacks run are evaluated in the next step
+    std::vector<std::size_t> dirty {};
+    dirty.swap(m_dirty);
+    for (const std::size_t i : dirty) {
+        if (i >= rows) {
+            continue;
+        }
+        m_marked[i] = 0;
+
+        const double f_location { m_loc_precision[i] / s_max_location_error };
+        const double f_time { m_time_acc[i] / s_max_timing_error };
+        const double f_rate { m_stddev_rate[i] / (m_mean_rate[i] * s_stddev_factor) };
+
+        std::int64_t flag { m_log_flags[i] };
+        flag |= (f_location > upper) ? s_flag_bad_location : 0;
+        flag |= (f_time > upper) ? s_flag_bad_time : 0;
+        flag |= (f_rate > upper) ? s_flag_bad_rate : 0;
+        flag |= (f_location < lower) ? s_flag_good_location : 0;
+        flag |= (f_time < lower) ? s_flag_good_time : 0;
+        flag |= (f_rate < lower) ? s_flag_good_rate : 0;
+
+        const double deficit { m_mean_rate[i] - m_current_rate[i] };
+        const double stddev { m_stddev_rate[i] };
+        const double factor { (deficit > stddev) ? ((deficit / stddev + 1.0) * scale) : 1.0 };
+
+        const auto previous { static_cast<detector_status::status>(m_status[i]) };
+        auto status { previous };
+        auto reason { detector_status::reason::miscellaneous };
+
+        if ((flag & s_flag_quit) != 0) {
+            status = detector_status::deleted;
+            reason = detector_status::reason::missed_log_interval;
+        } else if ((flag & s_flag_missed_log) != 0) {
+            status = detector_status::unreliable;
+            reason = detector_status::reason::missed_log_interval;
+        } else if ((flag & s_flag_bad_location) != 0) {
+            status = detector_status::unreliable;
+            reason = detector_status::reason::location_precision;
+        } else if ((flag & s_flag_bad_time) != 0) {
+            status = detector_status::unreliable;
+            reason = detector_status::reason::time_accuracy;
+        } else if ((flag & s_flag_bad_rate) != 0) {
+            status = detector_status::unreliable;
+            reason = detector_status::reason::rate_unstable;
+        } else if ((flag & s_flag_good) == s_flag_good) {
+            status = detector_status::reliable;
+        }
+
+        // +++ keep the largest factor up to date
+        if ((previous == detector_status::reliable) && (m_factor[i] >= m_largest) && ((status != detector_status::reliable) || (factor < m_factor[i]))) {
+            m_largest_valid = false;
+        }
+        if ((status == detector_status::reliable) && (factor > m_largest)) {
+            m_largest = factor;
+        }
+        m_factor[i] = factor;
+        // --- keep the largest factor up to date
+
+        if (status == previous) {
+            continue;
+        }
+        m_status[i] = static_cast<std::uint8_t>(status);
+        on_change(i, status, reason);
+    }
+    // --- evaluate the dirty rows
+
+    if (!m_largest_valid) {
+        largest();
+    }
+    return m_largest;
+}
+
+void detector_table::mark(std::size_t row)
+{
+    if (m_marked[row] != 0) {
+        return;
+    }
+    m_marked[row] = 1;
+    m_dirty.emplace_back(row);
+}
+
+void detector_table::largest()
+{
+    m_largest = 1.0;
+    for (std::size_t i { 0 }; i < m_hash.size(); i++) {
+        if ((m_status[i] == detector_status::reliable) && (m_factor[i] > m_largest)) {
+            m_largest = m_factor[i];
+        }
+    }
+    m_largest_valid = true;
+}
+
+} // namespace muonpi
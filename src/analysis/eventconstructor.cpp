@@ -4,6 +4,41 @@
 
 namespace muonpi {
 
+static void write_data(binary_writer& out, const event_t::data_t& data)
+{
+    out.write(data.location.lat);
+    out.write(data.location.lon);
+    out.write(data.location.h);
+    out.write(data.location.v_acc);
+    out.write(data.location.h_acc);
+    out.write(data.location.dop);
+    out.write(data.location.geohash);
+    out.write(data.location.max_geohash_length);
+    out.write(data.userinfo.username);
+    out.write(data.userinfo.station_id);
+    out.write(data.hash);
+    out.write(data.user);
+    out.write(data.station_id);
+    out.write(data.start);
+    out.write(data.end);
+    out.write(data.time_acc);
+    out.write(data.ublox_counter);
+    out.write(data.fix);
+    out.write(data.utc);
+    out.write(data.gnss_time_grid);
+}
+
+[[nodiscard]] static auto read_data(binary_reader& in, event_t::data_t& data) -> bool
+{
+    return in.read(data.location.lat) && in.read(data.location.lon) && in.read(data.location.h)
+        && in.read(data.location.v_acc) && in.read(data.location.h_acc) && in.read(data.location.dop)
+        && in.read(data.location.geohash) && in.read(data.location.max_geohash_length)
+        && in.read(data.userinfo.username) && in.read(data.userinfo.station_id)
+        && in.read(data.hash) && in.read(data.user) && in.read(data.station_id)
+        && in.read(data.start) && in.read(data.end) && in.read(data.time_acc)
+        && in.read(data.ublox_counter) && in.read(data.fix) && in.read(data.utc) && in.read(data.gnss_time_grid);
+}
+
 void event_constructor::set_timeout(std::chrono::system_clock::duration new_timeout)
 {
     if (new_timeout <= timeout) {
@@ -17,4 +52,50 @@ auto event_constructor::timed_out(std::chrono::system_clock::time_point now) con
     return (now - m_start) >= timeout;
 }
 
+void event_constructor::save(binary_writer& out) const
+{
+    out.write(static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(m_start.time_since_epoch()).count()));
+    out.write(static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count()));
+    save_event(out, event);
+}
+
+auto event_constructor::load(binary_reader& in) -> bool
+{
+    std::int64_t start {};
+    std::int64_t duration {};
+    event_t restored {};
+    if (!in.read(start) || !in.read(duration) || !load_event(in, restored)) {
+        return false;
+    }
+    m_start = std::chrono::system_clock::time_point { std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds { start }) };
+    timeout = std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds { duration });
+    event = std::move(restored);
+    return true;
+}
+
+void event_constructor::save_event(binary_writer& out, const event_t& event)
+{
+    write_data(out, event.data);
+    out.write(static_cast<std::uint32_t>(event.events.size()));
+    for (const auto& data : event.events) {
+        write_data(out, data);
+    }
+}
+
+auto event_constructor::load_event(binary_reader& in, event_t& event) -> bool
+{
+    std::uint32_t n {};
+    if (!read_data(in, event.data) || !in.read(n)) {
+        return false;
+    }
+    for (std::uint32_t i { 0 }; i < n; i++) {
+        event_t::data_t data {};
+        if (!read_data(in, data)) {
+            return false;
+        }
+        event.events.emplace_back(std::move(data));
+    }
+    return true;
+}
+
 } // namespace muonpi
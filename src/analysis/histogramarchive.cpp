@@ -0,0 +1,312 @@
+#include "analysis/histogramarchive.h"
+
+#include "utility/binarystream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace muonpi::archive {
+
+/**
+ * @brief The cursor class. Reads fixed size values from a memory region with bounds checking.
+ */
+class cursor {
+public:
+    cursor(const char* data, std::size_t size, std::size_t position)
+        : m_data { data }
+        , m_size { size }
+        , m_position { position }
+    {
+    }
+
+    template <typename T>
+    [[nodiscard]] auto read(T& value) -> bool
+    {
+        if ((m_position + sizeof(T)) > m_size) {
+            return false;
+        }
+        std::memcpy(&value, m_data + m_position, sizeof(T));
+        m_position += sizeof(T);
+        return true;
+    }
+
+    [[nodiscard]] auto read_varint(std::uint64_t& value) -> bool
+    {
+        value = 0;
+        for (std::uint32_t shift { 0 }; (shift < 64) && (m_position < m_size); shift += 7) {
+            const auto byte { static_cast<std::uint8_t>(m_data[m_position++]) };
+            value |= static_cast<std::uint64_t>(byte & 0x7fU) << shift;
+            if ((byte & 0x80U) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    [[nodiscard]] auto position() const -> std::size_t
+    {
+        return m_position;
+    }
+
+private:
+    const char* m_data { nullptr };
+    std::size_t m_size { 0 };
+    std::size_t m_position { 0 };
+};
+
+writer::writer(std::int64_t start, std::int64_t end, std::uint32_t bins)
+    : m_start { start }
+    , m_end { end }
+    , m_bins { bins }
+{
+}
+
+auto writer::add_station(station_t station) -> std::uint32_t
+{
+    m_stations.emplace_back(std::move(station));
+    return static_cast<std::uint32_t>(m_stations.size() - 1);
+}
+
+void writer::add_count(pair_t pair)
+{
+    if ((pair.total == 0) && (pair.uptime == 0)) {
+        return;
+    }
+    pair.offset = m_data.size();
+    pair.size = 0;
+    m_pairs.emplace_back(pair);
+}
+
+void writer::encode(std::uint64_t value)
+{
+    while (value >= 0x80U) {
+        m_data.push_back(static_cast<char>((value & 0x7fU) | 0x80U));
+        value >>= 7U;
+    }
+    m_data.push_back(static_cast<char>(value));
+}
+
+auto writer::write(const std::string& path) const -> bool
+{
+    std::vector<pair_t> pairs { m_pairs };
+    std::sort(pairs.begin(), pairs.end(), [](const pair_t& lhs, const pair_t& rhs) {
+        return std::tie(lhs.first, lhs.second) < std::tie(rhs.first, rhs.second);
+    });
+
+    std::string names {};
+    for (const auto& station : m_stations) {
+        names += station.site_id;
+    }
+
+    const std::string temporary { path + ".tmp" };
+    {
+        std::ofstream file { temporary, std::ios::binary | std::ios::trunc };
+        if (!file.is_open()) {
+            return false;
+        }
+        binary_writer out { file };
+
+        // +++ header
+        out.write(s_magic);
+        out.write(s_version);
+        out.write(std::uint16_t { 0 });
+        out.write(m_start);
+        out.write(m_end);
+        out.write(m_bins);
+        out.write(static_cast<std::uint32_t>(m_stations.size()));
+        out.write(static_cast<std::uint64_t>(pairs.size()));
+        out.write(static_cast<std::uint64_t>(names.size()));
+        // --- header
+
+        // +++ station table
+        std::uint32_t name_offset { 0 };
+        for (const auto& station : m_stations) {
+            out.write(station.hash);
+            out.write(station.lat);
+            out.write(station.lon);
+            out.write(station.h);
+            out.write(name_offset);
+            out.write(static_cast<std::uint32_t>(station.site_id.size()));
+            name_offset += static_cast<std::uint32_t>(station.site_id.size());
+        }
+        file.write(names.data(), static_cast<std::streamsize>(names.size()));
+        // --- station table
+
+        // +++ pair index
+        for (const auto& pair : pairs) {
+            out.write(pair.first);
+            out.write(pair.second);
+            out.write(pair.distance);
+            out.write(pair.lower);
+            out.write(pair.width);
+            out.write(pair.uptime);
+            out.write(pair.total);
+            out.write(pair.offset);
+            out.write(pair.size);
+        }
+        // --- pair index
+
+        file.write(m_data.data(), static_cast<std::streamsize>(m_data.size()));
+        if (!out.good()) {
+            return false;
+        }
+    }
+
+    std::error_code error {};
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+reader::~reader()
+{
+    close();
+}
+
+auto reader::open(const std::string& path) -> bool
+{
+    close();
+
+    const int fd { ::open(path.c_str(), O_RDONLY) };
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status { };
+    if ((fstat(fd, &status) != 0) || (status.st_size == 0)) {
+        ::close(fd);
+        return false;
+    }
+    void* data { mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0) };
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<std::size_t>(status.st_size);
+
+    cursor in { m_data, m_size, 0 };
+
+    std::uint32_t magic {};
+    std::uint16_t version {};
+    std::uint16_t reserved {};
+    std::uint32_t station_count {};
+    std::uint64_t pair_count {};
+    std::uint64_t names_size {};
+    if (!in.read(magic) || !in.read(version) || !in.read(reserved) || !in.read(m_start) || !in.read(m_end)
+        || !in.read(m_bins) || !in.read(station_count) || !in.read(pair_count) || !in.read(names_size)
+        || (magic != s_magic) || (version != s_version)) {
+        close();
+        return false;
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> names {};
+    for (std::uint32_t i { 0 }; i < station_count; i++) {
+        station_t station {};
+        std::uint32_t offset {};
+        std::uint32_t size {};
+        if (!in.read(station.hash) || !in.read(station.lat) || !in.read(station.lon) || !in.read(station.h) || !in.read(offset) || !in.read(size)) {
+            close();
+            return false;
+        }
+        names.emplace_back(offset, size);
+        m_stations.emplace_back(std::move(station));
+    }
+    // names_start is within the mapping, so the subtraction can not wrap, unlike an addition of a corrupt size
+    const std::size_t names_start { in.position() };
+    if (names_size > (m_size - names_start)) {
+        close();
+        return false;
+    }
+    for (std::size_t i { 0 }; i < names.size(); i++) {
+        const auto& [offset, size] { names[i] };
+        if ((static_cast<std::uint64_t>(offset) + size) > names_size) {
+            close();
+            return false;
+        }
+        m_stations[i].site_id.assign(m_data + names_start + offset, size);
+    }
+
+    in = cursor { m_data, m_size, names_start + names_size };
+    for (std::uint64_t i { 0 }; i < pair_count; i++) {
+        pair_t pair {};
+        if (!in.read(pair.first) || !in.read(pair.second) || !in.read(pair.distance) || !in.read(pair.lower) || !in.read(pair.width)
+            || !in.read(pair.uptime) || !in.read(pair.total) || !in.read(pair.offset) || !in.read(pair.size)
+            || (pair.first >= station_count) || (pair.second >= station_count)) {
+            close();
+            return false;
+        }
+        m_pairs.emplace_back(pair);
+    }
+    m_bin_data = in.position();
+    return true;
+}
+
+auto reader::start() const -> std::int64_t
+{
+    return m_start;
+}
+
+auto reader::end() const -> std::int64_t
+{
+    return m_end;
+}
+
+auto reader::bins() const -> std::uint32_t
+{
+    return m_bins;
+}
+
+auto reader::stations() const -> const std::vector<station_t>&
+{
+    return m_stations;
+}
+
+auto reader::pairs() const -> const std::vector<pair_t>&
+{
+    return m_pairs;
+}
+
+auto reader::for_each_bin(const pair_t& pair, const std::function<void(std::uint32_t, std::uint64_t)>& function) const -> bool
+{
+    if ((m_data == nullptr) || (pair.offset > (m_size - m_bin_data)) || (pair.size > (m_size - m_bin_data - pair.offset))) {
+        return false;
+    }
+    const std::size_t begin { m_bin_data + pair.offset };
+    const std::size_t end { begin + pair.size };
+    cursor in { m_data, end, begin };
+    std::uint64_t index { 0 };
+    while (in.position() < end) {
+        std::uint64_t delta {};
+        std::uint64_t count {};
+        if (!in.read_varint(delta) || !in.read_varint(count)) {
+            return false;
+        }
+        index += delta;
+        if (index >= m_bins) {
+            return false;
+        }
+        function(static_cast<std::uint32_t>(index), count);
+    }
+    return true;
+}
+
+void reader::close()
+{
+    if (m_data != nullptr) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_bin_data = 0;
+    m_stations.clear();
+    m_pairs.clear();
+}
+
+} // namespace muonpi::archive
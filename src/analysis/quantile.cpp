@@ -0,0 +1,105 @@
+#include "analysis/quantile.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace muonpi {
+
+p2_quantile::p2_quantile(double p)
+    : m_p { std::clamp(p, 0.0, 1.0) }
+    , m_increments { 0.0, m_p * 0.5, m_p, (1.0 + m_p) * 0.5, 1.0 }
+{
+    reset();
+}
+
+void p2_quantile::add(double value)
+{
+    // +++ the first five observations initialise the markers
+    if (m_n < 5) {
+        m_heights[m_n] = value;
+        m_n++;
+        if (m_n == 5) {
+            std::sort(m_heights.begin(), m_heights.end());
+        }
+        return;
+    }
+    // --- the first five observations initialise the markers
+
+    m_n++;
+
+    std::size_t k { 0 };
+    if (value < m_heights[0]) {
+        m_heights[0] = value;
+    } else if (value >= m_heights[4]) {
+        m_heights[4] = value;
+        k = 3;
+    } else {
+        while (value >= m_heights[k + 1]) {
+            k++;
+        }
+    }
+    for (std::size_t i { k + 1 }; i < 5; i++) {
+        m_positions[i]++;
+    }
+    for (std::size_t i { 0 }; i < 5; i++) {
+        m_desired[i] += m_increments[i];
+    }
+
+    // +++ move the inner markers towards their desired positions
+    for (std::size_t i { 1 }; i < 4; i++) {
+        const double d { m_desired[i] - static_cast<double>(m_positions[i]) };
+        if (((d >= 1.0) && ((m_positions[i + 1] - m_positions[i]) > 1)) || ((d <= -1.0) && ((m_positions[i - 1] - m_positions[i]) < -1))) {
+            const std::int64_t s { (d > 0.0) ? 1 : -1 };
+            const double height { parabolic(i, static_cast<double>(s)) };
+            if ((m_heights[i - 1] < height) && (height < m_heights[i + 1])) {
+                m_heights[i] = height;
+            } else {
+                m_heights[i] = linear(i, s);
+            }
+            m_positions[i] += s;
+        }
+    }
+    // --- move the inner markers towards their desired positions
+}
+
+auto p2_quantile::value() const -> double
+{
+    if (m_n == 0) {
+        return 0.0;
+    }
+    if (m_n < 5) {
+        std::array<double, 5> sorted { m_heights };
+        std::sort(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(m_n));
+        return sorted[static_cast<std::size_t>(std::lround(m_p * static_cast<double>(m_n - 1)))];
+    }
+    return m_heights[2];
+}
+
+auto p2_quantile::n() const -> std::size_t
+{
+    return m_n;
+}
+
+void p2_quantile::reset()
+{
+    m_n = 0;
+    m_heights = {};
+    m_positions = { 0, 1, 2, 3, 4 };
+    m_desired = { 0.0, 2.0 * m_p, 4.0 * m_p, 2.0 + 2.0 * m_p, 4.0 };
+}
+
+auto p2_quantile::parabolic(std::size_t i, double d) const -> double
+{
+    const double n_prev { static_cast<double>(m_positions[i - 1]) };
+    const double n_i { static_cast<double>(m_positions[i]) };
+    const double n_next { static_cast<double>(m_positions[i + 1]) };
+    return m_heights[i] + d / (n_next - n_prev) * ((n_i - n_prev + d) * (m_heights[i + 1] - m_heights[i]) / (n_next - n_i) + (n_next - n_i - d) * (m_heights[i] - m_heights[i - 1]) / (n_i - n_prev));
+}
+
+auto p2_quantile::linear(std::size_t i, std::int64_t d) const -> double
+{
+    const std::size_t j { static_cast<std::size_t>(static_cast<std::int64_t>(i) + d) };
+    return m_heights[i] + static_cast<double>(d) * (m_heights[j] - m_heights[i]) / static_cast<double>(m_positions[j] - m_positions[i]);
+}
+
+} // namespace muonpi
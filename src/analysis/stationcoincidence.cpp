@@ -1,7 +1,9 @@
 #include "analysis/stationcoincidence.h"
+#include "analysis/histogramarchive.h"
 
 #include "supervision/station.h"
 
+#include "utility/binarystream.h"
 #include "utility/coordinatemodel.h"
 #include "utility/utility.h"
 
@@ -9,17 +11,34 @@
 #include "utility/units.h"
 
 #include <algorithm>
+#include <cassert>
 #include <filesystem>
 #include <fstream>
+#include <numeric>
+#include <sstream>
+#include <tuple>
 
 namespace muonpi {
 
-station_coincidence::station_coincidence(std::string data_directory, supervision::station& stationsupervisor)
+enum class checkpoint_entry : std::uint8_t {
+    station,
+    bin
+};
+
+[[nodiscard]] static inline auto to_nanoseconds(const std::chrono::system_clock::time_point& time) -> std::int64_t
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+station_coincidence::station_coincidence(std::string data_directory, supervision::station& stationsupervisor, double max_distance)
     : thread_runner { "muon::coinc" }
     , m_stationsupervisor { stationsupervisor }
     , m_data_directory { std::move(data_directory) }
+    , m_max_distance { std::max(0.0, max_distance) }
+    , m_grid { m_max_distance }
 {
     reset();
+    recover();
     start();
 }
 
@@ -27,66 +46,96 @@ auto station_coincidence::step() -> int
 {
     std::mutex mx;
     std::unique_lock<std::mutex> lock { mx };
-    m_condition.wait_for(lock, config::singleton()->interval.histogram_sample_time);
-    if (!m_quit) {
+    m_condition.wait_for(lock, s_checkpoint_interval);
+    if (m_quit) {
+        return 0;
+    }
+    if ((std::chrono::system_clock::now() - m_last_save) >= config::singleton()->interval.histogram_sample_time) {
         save();
+    } else {
+        checkpoint();
     }
     return 0;
 }
 
 auto station_coincidence::post_run() -> int
 {
+    checkpoint();
     save();
     return 0;
 }
 
 void station_coincidence::get(event_t event)
 {
-    if ((event.n() < 2) || (m_saving)) {
+    if (event.n() < 2) {
         return;
     }
 
-    for (std::size_t i { 0 }; i < (event.n() - 1); i++) {
-        const std::size_t first_h { event.events.at(i).hash };
-        auto condition_1 = [&](const auto& iterator) { return iterator.first.hash() == first_h; };
-        auto it_1 { std::find_if(m_stations.begin(), m_stations.end(), condition_1) };
-        std::size_t first { static_cast<std::size_t>(std::distance(m_stations.begin(), it_1)) };
-        if (it_1 == m_stations.end()) {
-            const auto& [userinfo, location] { m_stationsupervisor.get_station(first_h) };
+    // +++ resolve the station indices. Only this method adds stations, so the lookup itself needs no lock
+    // as long as all events arrive from the same thread.
+    if (m_event_thread == std::thread::id {}) {
+        m_event_thread = std::this_thread::get_id();
+    }
+    assert(m_event_thread == std::this_thread::get_id());
+
+    std::vector<std::size_t> indices {};
+    indices.reserve(event.n());
+    for (const auto& data : event.events) {
+        std::size_t index { index_of(data.hash) };
+        if (index == m_stations.size()) {
+            const auto& [userinfo, location] { m_stationsupervisor.get_station(data.hash) };
+            std::unique_lock<std::shared_mutex> lock { m_mutex };
             add_station(userinfo, location);
-            first = m_stations.size() - 1;
+            index = m_stations.size() - 1;
         }
+        indices.emplace_back(index);
+    }
+    // --- resolve the station indices
+
+    std::vector<journal_t::bin_t> changed {};
+
+    std::shared_lock<std::shared_mutex> lock { m_mutex };
+    for (std::size_t i { 0 }; i < (event.n() - 1); i++) {
+        const std::size_t first_h { event.events.at(i).hash };
+        const std::size_t first { indices.at(i) };
         const auto first_t { event.events.at(i).start };
         for (std::size_t j { i + 1 }; j < event.n(); j++) {
             const std::size_t second_h { event.events.at(j).hash };
-            auto condition_2 = [&](const auto& iterator) { return iterator.first.hash() == second_h; };
-            auto it_2 { std::find_if(m_stations.begin(), m_stations.end(), condition_2) };
-            std::size_t second { static_cast<std::size_t>(std::distance(m_stations.begin(), it_2)) };
-            if (it_2 == m_stations.end()) {
-                const auto& [userinfo, location] { m_stationsupervisor.get_station(second_h) };
-                add_station(userinfo, location);
-                second = m_stations.size() - 1;
-            }
+            const std::size_t second { indices.at(j) };
             const auto second_t { event.events.at(j).start };
 
-            auto& pair { m_data.at(std::max(first, second), std::min(first, second)) };
-            if (second_h > first_h) {
-                pair.hist.add(static_cast<std::int32_t>(first_t - second_t));
+            auto& data { m_data.at(std::max(first, second), std::min(first, second)) };
+            std::size_t bin { s_bins };
+            if (data.hist == nullptr) {
+                // pairs without histogram are journaled with the bin index s_bins
+                data.count[m_generation]++;
+            } else if (second_h > first_h) {
+                bin = (*data.hist)[m_generation].add(static_cast<std::int32_t>(first_t - second_t));
             } else {
-                pair.hist.add(static_cast<std::int32_t>(second_t - first_t));
+                bin = (*data.hist)[m_generation].add(static_cast<std::int32_t>(second_t - first_t));
+            }
+            if ((data.hist != nullptr) && (bin >= s_bins)) {
+                continue;
+            }
+            if (m_checkpoint != nullptr) {
+                changed.emplace_back(journal_t::bin_t { first_h, second_h, static_cast<std::uint32_t>(bin) });
             }
         }
     }
+
+    if (!changed.empty()) {
+        std::scoped_lock<std::mutex> journal_lock { m_journal_mutex };
+        m_journal.bins.insert(m_journal.bins.end(), changed.begin(), changed.end());
+    }
 }
 
 void station_coincidence::get(trigger::detector trig)
 {
-    auto condition_1 = [&](const auto& iterator) { return iterator.first.hash() == trig.hash; };
-    auto it_1 { std::find_if(m_stations.begin(), m_stations.end(), condition_1) };
-    if (it_1 == m_stations.end()) {
+    std::unique_lock<std::shared_mutex> lock { m_mutex };
+    const std::size_t index { index_of(trig.hash) };
+    if (index == m_stations.size()) {
         return;
     }
-    std::size_t index { static_cast<std::size_t>(std::distance(m_stations.begin(), it_1)) };
 
     m_data.iterate(index, [&](data_t& data) {
         switch (trig.status) {
@@ -124,97 +173,199 @@ void station_coincidence::save()
 
     m_last_save = now;
     log::debug() << "Saving histogram data.";
-    m_saving = true;
 
-    std::ofstream stationfile { m_data_directory + "/" + filename + ".stations" };
+    // +++ swap in a fresh generation and take the retired one out.
+    // Changes journaled until now belong to the retired generation. The event collection only ever touches the current generation
+    // and the histograms are heap allocated per pair, so the retired histograms stay valid and can be written without any lock.
+    struct retired_t {
+        archive::pair_t pair {};
+        histogram_t* hist { nullptr }; //< nullptr for pairs which only count their coincidences
+    };
+    std::vector<std::pair<userinfo_t, location_t>> stations {};
+    std::vector<retired_t> pairs {};
+    {
+        std::unique_lock<std::shared_mutex> lock { m_mutex };
+        const std::size_t retired { m_generation };
+        m_generation = retired ^ 1U;
+        stations = m_stations;
+        for (std::size_t x { 1 }; x < m_stations.size(); x++) {
+            for (std::size_t y { 0 }; y < x; y++) {
+                auto& data { m_data.at(x, y) };
+                if (data.online == 2) {
+                    data.uptime += std::chrono::duration_cast<std::chrono::minutes>(now - data.last_online).count();
+                    data.last_online = now;
+                }
+                retired_t entry {};
+                entry.pair.first = static_cast<std::uint32_t>(x);
+                entry.pair.second = static_cast<std::uint32_t>(y);
+                entry.pair.uptime = data.uptime;
+                data.uptime = 0;
+                if (data.hist == nullptr) {
+                    entry.pair.total = data.count[retired];
+                    data.count[retired] = 0;
+                } else {
+                    entry.hist = &(*data.hist)[retired];
+                    entry.pair.distance = data.distance;
+                }
+                // pairs which were online without a coincidence are kept for their uptime, the exposure would be undercounted otherwise
+                if ((entry.pair.uptime > 0) || (entry.pair.total > 0) || ((entry.hist != nullptr) && !entry.hist->empty())) {
+                    pairs.emplace_back(entry);
+                }
+            }
+        }
+        std::scoped_lock<std::mutex> journal_lock { m_journal_mutex };
+        m_journal = {};
+    }
+    // --- swap in a fresh generation and take the retired one out
 
-    std::map<std::size_t, userinfo_t> stations {};
-    std::map<std::size_t, std::map<std::size_t, std::size_t>> station_matrix {};
+    archive::writer archive { to_nanoseconds(now - duration), to_nanoseconds(now), s_bins };
+    for (const auto& [userinfo, location] : stations) {
+        archive.add_station(archive::station_t { userinfo.hash(), userinfo.site_id(), location.lat, location.lon, location.h });
+    }
 
-    std::map<std::size_t, std::size_t> row_vector {};
+    for (auto& [pair, hist] : pairs) {
+        if (hist == nullptr) {
+            pair.distance = static_cast<float>(distance(stations.at(pair.first).second, stations.at(pair.second).second));
+            archive.add_count(pair);
+            continue;
+        }
+        pair.lower = hist->lower();
+        pair.width = hist->width();
+        archive.add_pair(pair, *hist);
+        hist->clear();
+    }
 
-    for (const auto& [userinfo, location] : m_stations) {
-        row_vector.emplace(userinfo.hash(), 0);
+    if (!archive.write(m_data_directory + "/" + filename + ".hists")) {
+        log::warning() << "Could not write histogram archive '" << m_data_directory << "/" << filename << ".hists'.";
     }
 
-    for (const auto& [userinfo, location] : m_stations) {
-        stations.emplace(userinfo.hash(), userinfo);
+    if (m_checkpoint != nullptr) {
+        m_checkpoint->reset(to_nanoseconds(now));
+        write_checkpoint(journal_t { stations, {} });
+    }
+}
 
-        station_matrix.emplace(userinfo.hash(), row_vector);
+void station_coincidence::checkpoint()
+{
+    if (m_checkpoint == nullptr) {
+        return;
+    }
+    journal_t journal {};
+    {
+        std::scoped_lock<std::mutex> lock { m_journal_mutex };
+        std::swap(journal, m_journal);
+    }
+    write_checkpoint(journal);
+}
 
-        stationfile << std::hex << userinfo.hash() << ';' << userinfo.site_id() << ';' << location.lat << ';' << location.lon << ';' << location.h << '\n';
+void station_coincidence::write_checkpoint(const journal_t& journal)
+{
+    std::ostringstream stream {};
+    binary_writer out { stream };
+
+    for (const auto& [userinfo, location] : journal.stations) {
+        out.write(checkpoint_entry::station);
+        out.write(userinfo.username);
+        out.write(userinfo.station_id);
+        out.write(location.lat);
+        out.write(location.lon);
+        out.write(location.h);
     }
-    stationfile.close();
 
-    for (auto& data : m_data.data()) {
-        if (data.online == 2) {
-            data.uptime += std::chrono::duration_cast<std::chrono::minutes>(now - data.last_online).count();
-            data.last_online = now;
-        }
+    // +++ merge all increments of the same bin into one entry
+    std::vector<journal_t::bin_t> bins { journal.bins };
+    std::sort(bins.begin(), bins.end(), [](const journal_t::bin_t& lhs, const journal_t::bin_t& rhs) {
+        return std::tie(lhs.first, lhs.second, lhs.index) < std::tie(rhs.first, rhs.second, rhs.index);
+    });
+    for (auto it { bins.begin() }; it != bins.end();) {
+        const auto end { std::find_if(it, bins.end(), [&](const journal_t::bin_t& bin) {
+            return (bin.first != it->first) || (bin.second != it->second) || (bin.index != it->index);
+        }) };
+        out.write(checkpoint_entry::bin);
+        out.write(static_cast<std::uint64_t>(it->first));
+        out.write(static_cast<std::uint64_t>(it->second));
+        out.write(it->index);
+        out.write(static_cast<std::uint32_t>(std::distance(it, end)));
+        it = end;
+    }
+    // --- merge all increments of the same bin into one entry
 
-        station_matrix[data.first][data.second] = data.hist.integral();
-        station_matrix[data.second][data.first] = data.hist.integral();
+    const std::string data { stream.str() };
+    if (!data.empty() && !m_checkpoint->append(data)) {
+        log::warning() << "Could not write histogram checkpoint.";
+    }
+}
 
-        std::ostringstream dir_stream {};
-        dir_stream << m_data_directory << '/';
-        std::string first_site { stations[data.first].site_id() };
-        std::string second_site { stations[data.second].site_id() };
+void station_coincidence::recover()
+{
+    const std::string& state { config::singleton()->files.state };
+    if (state.empty()) {
+        return;
+    }
+    m_checkpoint = std::make_unique<mapped_file>(state + ".histograms", s_checkpoint_magic);
+    if (!m_checkpoint->is_open()) {
+        m_checkpoint.reset();
+        return;
+    }
 
-        std::replace(first_site.begin(), first_site.end(), '/', '-');
-        std::replace(second_site.begin(), second_site.end(), '/', '-');
+    const std::int64_t epoch { m_checkpoint->epoch() };
+    if (epoch == 0) {
+        m_checkpoint->reset(to_nanoseconds(m_last_save));
+        write_checkpoint(journal_t { m_stations, {} });
+        return;
+    }
 
-        if (data.first < data.second) {
-            dir_stream << first_site
-                       << "_"
-                       << second_site;
+    std::istringstream stream { std::string { m_checkpoint->content() } };
+    binary_reader in { stream };
+    std::size_t recovered { 0 };
+    checkpoint_entry type {};
+    while (in.read(type)) {
+        if (type == checkpoint_entry::station) {
+            userinfo_t userinfo {};
+            location_t location {};
+            if (!in.read(userinfo.username) || !in.read(userinfo.station_id) || !in.read(location.lat) || !in.read(location.lon) || !in.read(location.h)) {
+                break;
+            }
+            if (index_of(userinfo.hash()) == m_stations.size()) {
+                add_station(userinfo, location);
+            }
+        } else if (type == checkpoint_entry::bin) {
+            std::uint64_t first_h {};
+            std::uint64_t second_h {};
+            std::uint32_t index {};
+            std::uint32_t count {};
+            if (!in.read(first_h) || !in.read(second_h) || !in.read(index) || !in.read(count)) {
+                break;
+            }
+            const std::size_t first { index_of(first_h) };
+            const std::size_t second { index_of(second_h) };
+            if ((first == m_stations.size()) || (second == m_stations.size()) || (first == second)) {
+                continue;
+            }
+            auto& data { m_data.at(std::max(first, second), std::min(first, second)) };
+            if ((data.hist == nullptr) || (index >= s_bins)) {
+                data.count[m_generation] += count;
+            } else {
+                (*data.hist)[m_generation].increment(index, count);
+            }
+            recovered += count;
         } else {
-            dir_stream << second_site
-                       << "_"
-                       << first_site;
-        }
-        dir_stream << '/';
-        if (!std::filesystem::exists(dir_stream.str())) {
-            std::filesystem::create_directories(dir_stream.str());
-        }
-        dir_stream << filename;
-
-        std::ofstream histogram_file { dir_stream.str() + ".hist" };
-        for (const auto& bin : data.hist.qualified_bins()) {
-            histogram_file << ((bin.lower + bin.upper) / 2) << ' ' << bin.count << '\n';
-        }
-        histogram_file.close();
-
-        std::ofstream metadata_file { dir_stream.str() + ".meta" };
-        metadata_file
-            << "bin_width " << std::to_string(data.hist.width()) << " ns\n"
-            << "distance " << data.distance << " m\n"
-            << "total " << std::to_string(data.hist.integral()) << " 1\n"
-            << "uptime " << std::to_string(data.uptime) << " min\n"
-            << "sample_time " << std::to_string(std::chrono::duration_cast<std::chrono::minutes>(duration).count()) << "min\n";
-        metadata_file.close();
-        data.uptime = 0;
-        data.hist.clear();
-    }
-    std::ofstream adjacentfile { m_data_directory + "/" + filename + ".adj" };
-    for (const auto& [hash, row] : row_vector) {
-        adjacentfile << ';' << std::hex << hash;
-    }
-    adjacentfile << '\n';
-    for (const auto& [hash, row] : station_matrix) {
-        adjacentfile << std::hex << hash;
-        for (const auto& [inner_hash, n] : row) {
-            adjacentfile << ';' << std::dec << n;
+            break;
         }
-        adjacentfile << '\n';
     }
-    adjacentfile.close();
-    m_saving = false;
+
+    m_last_save = std::chrono::system_clock::time_point { std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds { epoch }) };
+    m_journal = {};
+    write_checkpoint(journal_t { m_stations, {} });
+    log::info() << "Recovered " << recovered << " histogram entries from checkpoint.";
 }
 
 void station_coincidence::reset()
 {
     m_stations.clear();
+    m_index.clear();
     m_data.reset();
+    m_grid.clear();
 
     for (const auto& [userinfo, location] : m_stationsupervisor.get_stations()) {
         add_station(userinfo, location);
@@ -225,18 +376,55 @@ void station_coincidence::add_station(const userinfo_t& userinfo, const location
 {
     const auto x { m_data.increase() };
     m_stations.emplace_back(std::make_pair(userinfo, location));
-    if (x > 0) {
-        coordinate::geodetic<double> first { location.lat * units::degree, location.lon * units::degree, location.h };
-        for (std::size_t y { 0 }; y < x; y++) {
-            const auto& [user, loc] { m_stations.at(y) };
-            const auto distance { coordinate::transformation<double, coordinate::WGS84>::straight_distance(first, { loc.lat * units::degree, loc.lon * units::degree, loc.h }) };
-            const auto time_of_flight { distance / consts::c_0 };
-            const std::int32_t bin_width { static_cast<std::int32_t>(std::clamp((2.0 * time_of_flight) / static_cast<double>(s_bins), 1.0, s_total_width / static_cast<double>(s_bins))) };
-            const std::int32_t min { bin_width * -static_cast<std::int32_t>(s_bins * 0.5) };
-            const std::int32_t max { bin_width * static_cast<std::int32_t>(s_bins * 0.5) };
-            m_data.emplace(x, y, { userinfo.hash(), user.hash(), static_cast<float>(distance), histogram_t { min, max } });
+    m_index.emplace(userinfo.hash(), x);
+    if (m_checkpoint != nullptr) {
+        std::scoped_lock<std::mutex> lock { m_journal_mutex };
+        m_journal.stations.emplace_back(std::make_pair(userinfo, location));
+    }
+
+    std::vector<std::size_t> candidates {};
+    if (m_max_distance > 0.0) {
+        candidates = m_grid.neighbours(location.lat, location.lon);
+        m_grid.insert(x, location.lat, location.lon);
+    } else {
+        candidates.resize(x);
+        std::iota(candidates.begin(), candidates.end(), 0);
+    }
+
+    for (const auto y : candidates) {
+        const double separation { distance(x, y) };
+        if ((m_max_distance > 0.0) && (separation > m_max_distance)) {
+            continue;
         }
+        const auto time_of_flight { separation / consts::c_0 };
+        const std::int32_t bin_width { static_cast<std::int32_t>(std::clamp((2.0 * time_of_flight) / static_cast<double>(s_bins), 1.0, s_total_width / static_cast<double>(s_bins))) };
+        const std::int32_t min { bin_width * -static_cast<std::int32_t>(s_bins * 0.5) };
+        const std::int32_t max { bin_width * static_cast<std::int32_t>(s_bins * 0.5) };
+        auto& data { m_data.at(x, y) };
+        data.distance = static_cast<float>(separation);
+        data.hist = std::make_unique<std::array<histogram_t, 2>>(std::array<histogram_t, 2> { histogram_t { min, max }, histogram_t { min, max } });
+    }
+}
+
+auto station_coincidence::distance(std::size_t first, std::size_t second) const -> double
+{
+    return distance(m_stations.at(first).second, m_stations.at(second).second);
+}
+
+auto station_coincidence::distance(const location_t& lhs, const location_t& rhs) -> double
+{
+    return coordinate::transformation<double, coordinate::WGS84>::straight_distance(
+        coordinate::geodetic<double> { lhs.lat * units::degree, lhs.lon * units::degree, lhs.h },
+        coordinate::geodetic<double> { rhs.lat * units::degree, rhs.lon * units::degree, rhs.h });
+}
+
+auto station_coincidence::index_of(std::size_t hash) const -> std::size_t
+{
+    const auto it { m_index.find(hash) };
+    if (it == m_index.end()) {
+        return m_stations.size();
     }
+    return it->second;
 }
 
 } // namespace muonpi
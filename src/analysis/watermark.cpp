@@ -0,0 +1,53 @@
+#include "analysis/watermark.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace muonpi {
+
+void watermark::arrived(std::uint64_t hash, std::int64_t start, std::int64_t now)
+{
+    const double lag { static_cast<double>(now - start) };
+    station_t& station { m_stations[hash] };
+    station.last = now;
+    if (station.n == 0) {
+        station.mean = lag;
+        station.deviation = std::abs(lag) * 0.5;
+    } else {
+        // same gains as the round trip estimation in TCP
+        const double error { lag - station.mean };
+        station.mean += error * 0.125;
+        station.deviation += (std::abs(error) - station.deviation) * 0.25;
+    }
+    station.n++;
+}
+
+void watermark::advance(std::int64_t now, std::int64_t maximum)
+{
+    double lag { 0.0 };
+    bool reliable { false };
+    for (auto it { m_stations.begin() }; it != m_stations.end();) {
+        const station_t& station { it->second };
+        if ((now - station.last) > s_stale) {
+            it = m_stations.erase(it);
+            continue;
+        }
+        if (station.n >= s_minimum_samples) {
+            lag = std::max(lag, station.mean + 4.0 * station.deviation);
+            reliable = true;
+        }
+        ++it;
+    }
+    if (!reliable) {
+        lag = static_cast<double>(maximum);
+    }
+    // the watermark never moves back, events behind it count as late
+    m_current = std::max(m_current, now - std::min(static_cast<std::int64_t>(lag), maximum));
+}
+
+auto watermark::current() const -> std::int64_t
+{
+    return m_current;
+}
+
+} // namespace muonpi
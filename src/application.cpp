@@ -6,6 +6,7 @@
 
 #include "analysis/coincidencefilter.h"
 #include "analysis/stationcoincidence.h"
+#include "analysis/sweepfilter.h"
 #include "supervision/station.h"
 
 #include "messages/detectorlog.h"
@@ -24,6 +25,7 @@
 #include "utility/configuration.h"
 #include "utility/exceptions.h"
 
+#include <algorithm>
 #include <exception>
 #include <memory>
 
@@ -48,6 +50,19 @@ auto application::setup(int argc, const char* argv[]) -> bool
 template <typename T>
 using sink_ptr = std::unique_ptr<sink::base<T>>;
 
+template <typename Criterion>
+auto make_coincidence_engine(const std::string& engine, sink::base<event_t>& event_sink, supervision::state& supervisor, std::size_t threads) -> std::unique_ptr<coincidence_engine>
+{
+    if (engine == "constructor") {
+        return std::make_unique<coincidence_filter<Criterion>>(event_sink, supervisor, threads);
+    }
+    if (engine == "sweep") {
+        return std::make_unique<sweep_filter<Criterion>>(event_sink, supervisor, threads);
+    }
+    log::error() << "Unknown coincidence engine '" << engine << "'.";
+    return nullptr;
+}
+
 auto application::run() -> int
 {
     return s_singleton->priv_run();
@@ -97,6 +112,7 @@ auto application::priv_run() -> int
     sink::collection<detector_summary_t> collection_detectorsummary_sink { "muon::sink::d" };
     sink::collection<trigger::detector> collection_trigger_sink { "muon::sink::t" };
     sink::collection<detector_log_t> collection_detectorlog_sink { "muon::sink::l" };
+    sink::collection<detector_info_t<location_t>> collection_location_sink { "muon::sink::p" };
 
     if (config::singleton()->option_set("debug")) {
         ascii_event_sink = std::make_unique<sink::ascii<event_t>>(std::cout);
@@ -140,18 +156,36 @@ auto application::priv_run() -> int
     }
 
     m_supervisor = std::make_unique<supervision::state>(collection_clusterlog_sink);
-    coincidence_filter coincidencefilter { collection_event_sink, *m_supervisor };
-    supervision::timebase timebasesupervisor { coincidencefilter, coincidencefilter };
+    std::unique_ptr<coincidence_engine> coincidencefilter { nullptr };
+    const auto engine { config::singleton()->get_option<std::string>("coincidence_engine") };
+    const auto criterion { config::singleton()->get_option<std::string>("coincidence_criterion") };
+    const auto threads { static_cast<std::size_t>(std::max(config::singleton()->get_option<int>("coincidence_threads"), 1)) };
+    if (criterion == "simple") {
+        coincidencefilter = make_coincidence_engine<simple_coincidence>(engine, collection_event_sink, *m_supervisor, threads);
+    } else if (criterion == "geometric") {
+        coincidencefilter = make_coincidence_engine<coincidence>(engine, collection_event_sink, *m_supervisor, threads);
+    } else {
+        log::error() << "Unknown coincidence criterion '" << criterion << "'.";
+    }
+    if (coincidencefilter == nullptr) {
+        return -1;
+    }
+
+    supervision::timebase timebasesupervisor { *coincidencefilter, *coincidencefilter, *m_supervisor, config::singleton()->get_option<double>("timebase_percentile") / 100.0 };
     supervision::station stationsupervisor { collection_detectorsummary_sink, collection_trigger_sink, timebasesupervisor, timebasesupervisor, *m_supervisor };
 
     source::mqtt<event_t> event_source { stationsupervisor, source_mqtt_link.subscribe("muonpi/data/#") };
     source::mqtt<event_t> l1_source { stationsupervisor, source_mqtt_link.subscribe("muonpi/l1data/#") };
-    source::mqtt<detector_info_t<location_t>> detector_location_source { stationsupervisor, source_mqtt_link.subscribe("muonpi/log/#") };
+    collection_location_sink.emplace(stationsupervisor);
+    collection_location_sink.emplace(*coincidencefilter);
+    collection_trigger_sink.emplace(*coincidencefilter);
+
+    source::mqtt<detector_info_t<location_t>> detector_location_source { collection_location_sink, source_mqtt_link.subscribe("muonpi/log/#") };
 
     source::mqtt<detector_log_t> detectorlog_source { collection_detectorlog_sink, source_mqtt_link.subscribe("muonpi/log/#") };
 
     if (config::singleton()->option_set("histogram")) {
-        stationcoincidence = std::make_unique<station_coincidence>(config::singleton()->get_option<std::string>("histogram"), stationsupervisor);
+        stationcoincidence = std::make_unique<station_coincidence>(config::singleton()->get_option<std::string>("histogram"), stationsupervisor, config::singleton()->get_option<double>("histogram_max_distance") * units::kilometer);
 
         collection_event_sink.emplace(*stationcoincidence);
         collection_trigger_sink.emplace(*stationcoincidence);
@@ -160,7 +194,7 @@ auto application::priv_run() -> int
     }
 
     m_supervisor->add_thread(stationsupervisor);
-    m_supervisor->add_thread(coincidencefilter);
+    m_supervisor->add_thread(*coincidencefilter);
     if (sink_mqtt_link != nullptr) {
         m_supervisor->add_thread(*sink_mqtt_link);
     }
@@ -170,6 +204,7 @@ auto application::priv_run() -> int
     m_supervisor->add_thread(collection_clusterlog_sink);
     m_supervisor->add_thread(collection_trigger_sink);
     m_supervisor->add_thread(collection_detectorlog_sink);
+    m_supervisor->add_thread(collection_location_sink);
 
     std::signal(SIGINT, wrapper_signal_handler);
     std::signal(SIGTERM, wrapper_signal_handler);
@@ -19,24 +19,43 @@ void state::time_status(std::chrono::milliseconds timebase, std::chrono::millise
     m_timeout = timeout;
 }
 
+void state::delay_status(double median, double percentile, std::size_t excluded)
+{
+    m_current_data.delay.median = median;
+    m_current_data.delay.percentile = percentile;
+    m_current_data.excluded_detectors = excluded;
+}
+
 void state::on_detector_status(std::size_t hash, detector_status::status status)
 {
-    m_detectors[hash] = status;
-    if (status == detector_status::deleted) {
-        if (m_detectors.find(hash) != m_detectors.end()) {
-            m_detectors.erase(hash);
+    const auto it { m_detectors.find(hash) };
+    if (it != m_detectors.end()) {
+        m_status_count[it->second]--;
+        if (status == detector_status::deleted) {
+            m_detectors.erase(it);
+            m_total_detectors--;
+            return;
         }
+        it->second = status;
+        m_status_count[status]++;
+        return;
     }
-
-    std::size_t reliable { 0 };
-    for (auto& [h, detector] : m_detectors) {
-        if (detector == detector_status::reliable) {
-            reliable++;
-        }
+    if (status == detector_status::deleted) {
+        return;
     }
+    m_detectors.emplace(hash, status);
+    m_status_count[status]++;
+    m_total_detectors++;
+}
 
-    m_current_data.total_detectors = m_detectors.size();
-    m_current_data.reliable_detectors = reliable;
+auto state::detectors(detector_status::status status) const -> std::size_t
+{
+    return m_status_count[status].load();
+}
+
+auto state::total_detectors() const -> std::size_t
+{
+    return m_total_detectors.load();
 }
 
 auto state::step() -> int
@@ -61,12 +80,16 @@ auto state::step() -> int
     m_system_cpu_load.add(data.system_cpu_load);
     m_current_data.system_cpu_load = m_system_cpu_load.mean();
 
+    m_current_data.total_detectors = total_detectors();
+    m_current_data.reliable_detectors = detectors(detector_status::reliable);
+
     if ((now - m_last) >= config::singleton()->interval.clusterlog) {
         m_last = now;
 
         source::base<cluster_log_t>::put(m_current_data);
 
         m_current_data.incoming = 0;
+        m_current_data.late = 0;
         m_current_data.outgoing.clear();
     }
 
@@ -115,6 +138,11 @@ void state::increase_event_count(bool incoming, std::size_t n)
     }
 }
 
+void state::increase_late_count()
+{
+    m_current_data.late++;
+}
+
 void state::set_queue_size(std::size_t size)
 {
     m_current_data.buffer_length = size;
@@ -4,12 +4,17 @@
 #include "messages/detectorsummary.h"
 #include "messages/event.h"
 #include "source/base.h"
+#include "utility/binarystream.h"
 #include "utility/log.h"
 
 #include "defaults.h"
 
 #include "supervision/state.h"
 
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
 namespace muonpi::supervision {
 
 constexpr static std::chrono::duration s_timeout { std::chrono::milliseconds { 100 } };
@@ -26,22 +31,25 @@ station::station(sink::base<detector_summary_t>& summary_sink, sink::base<trigge
 
 void station::get(event_t event)
 {
-    auto det_iterator { m_detectors.find(event.data.hash) };
-    if (det_iterator == m_detectors.end()) {
-        return;
-    }
-    auto& det { (*det_iterator).second };
-
-    if (!det->process(event)) {
-        return;
-    }
+    {
+        std::scoped_lock<std::mutex> lock { m_mutex };
+        auto det_iterator { m_detectors.find(event.data.hash) };
+        if (det_iterator == m_detectors.end()) {
+            return;
+        }
+        auto& det { (*det_iterator).second };
 
-    event.data.location = det->location();
-    event.data.userinfo = det->user_info();
+        if (!det->process(event)) {
+            return;
+        }
 
-    if (det->is(detector_status::reliable)) {
-        source::base<event_t>::put(std::move(event));
+        if (!det->is(detector_status::reliable)) {
+            return;
+        }
+        event.data.location = det->location();
+        event.data.userinfo = det->user_info();
     }
+    source::base<event_t>::put(std::move(event));
 }
 
 void station::get(detector_info_t<location_t> detector_info)
@@ -51,10 +59,15 @@ void station::get(detector_info_t<location_t> detector_info)
 
 auto station::process(detector_info_t<location_t> log) -> int
 {
+    if (!m_restored) {
+        restore();
+    }
+    std::scoped_lock<std::mutex> lock { m_mutex };
     auto det { m_detectors.find(log.hash) };
     if (det == m_detectors.end()) {
-        m_detectors.emplace(log.hash, std::make_unique<detector_station>(log, *this));
+        m_detectors.emplace(log.hash, std::make_unique<detector_station>(log, m_table, *this));
         m_detectors.at(log.hash)->enable();
+        schedule(log.hash);
         return 0;
     }
     (*det).second->process(log);
@@ -64,40 +77,239 @@ auto station::process(detector_info_t<location_t> log) -> int
 auto station::process() -> int
 {
     using namespace std::chrono;
+
+    if (!m_restored) {
+        restore();
+    }
+
+    const system_clock::time_point now { system_clock::now() };
+
+    double largest {};
     {
-        double largest { 1.0 };
-        system_clock::time_point now { system_clock::now() };
-        for (auto& [hash, det] : m_detectors) {
+        std::scoped_lock<std::mutex> lock { m_mutex };
 
-            det->step(now);
+        // +++ only touch the detectors which have due maintenance tasks
+        m_schedule.expire(now, [this, &now](system_clock::time_point /*due*/, maintenance task) {
+            maintain(now, task);
+        });
+        // --- only touch the detectors which have due maintenance tasks
 
-            if (det->is(detector_status::reliable)) {
-                if (det->factor() > largest) {
-                    largest = det->factor();
-                }
+        largest = m_table.step([this](std::size_t row, detector_status::status status, detector_status::reason reason) {
+            on_detector_status(m_table.hash(row), status, reason);
+        });
+
+        while (!m_delete_detectors.empty()) {
+            const auto det { m_detectors.find(m_delete_detectors.front()) };
+            m_delete_detectors.pop();
+            if (det == m_detectors.end()) {
+                continue;
+            }
+            const std::size_t row { det->second->row() };
+            m_generations.erase(det->first);
+            m_detectors.erase(det);
+            const std::size_t moved { m_table.erase(row) };
+            if (m_detectors.find(moved) != m_detectors.end()) {
+                m_detectors.at(moved)->set_row(row);
             }
         }
-        source::base<timebase_t>::put(timebase_t { largest });
     }
+    source::base<timebase_t>::put(timebase_t { largest });
 
-    while (!m_delete_detectors.empty()) {
-        m_detectors.erase(m_delete_detectors.front());
-        m_delete_detectors.pop();
+    if ((now - m_last_checkpoint) >= s_checkpoint_interval) {
+        m_last_checkpoint = now;
+        checkpoint();
     }
 
-    // +++ push detector log messages at regular interval
-    steady_clock::time_point now { steady_clock::now() };
+    return 0;
+}
+
+auto station::post_run() -> int
+{
+    checkpoint();
+    return 0;
+}
+
+[[nodiscard]] static inline auto to_nanoseconds(const std::chrono::system_clock::time_point& time) -> std::int64_t
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+[[nodiscard]] static inline auto from_nanoseconds(std::int64_t time) -> std::chrono::system_clock::time_point
+{
+    return std::chrono::system_clock::time_point { std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds { time }) };
+}
+
+void station::checkpoint()
+{
+    const std::string& path { config::singleton()->files.state };
+    if (path.empty()) {
+        return;
+    }
+    const std::string temporary { path + ".tmp" };
 
-    if ((now - m_last) >= config::singleton()->interval.detectorsummary) {
-        m_last = now;
+    std::error_code error {};
+    std::filesystem::create_directories(std::filesystem::path { path }.parent_path(), error);
 
-        for (auto& [hash, det] : m_detectors) {
-            source::base<detector_summary_t>::put(det->current_log_data());
+    // the records are collected with the mutex held, the file is written without it
+    std::vector<std::string> records {};
+    {
+        std::scoped_lock<std::mutex> lock { m_mutex };
+        records.reserve(m_detectors.size());
+        std::ostringstream stream {};
+        for (const auto& [hash, det] : m_detectors) {
+            stream.str({});
+            binary_writer record { stream };
+            const userinfo_t userinfo { det->user_info() };
+            const location_t location { det->location() };
+            record.write(static_cast<std::uint64_t>(hash));
+            record.write(to_nanoseconds(m_table.last_log(det->row())));
+            record.write(userinfo.username);
+            record.write(userinfo.station_id);
+            record.write(location.lat);
+            record.write(location.lon);
+            record.write(location.h);
+            record.write(location.v_acc);
+            record.write(location.h_acc);
+            record.write(location.dop);
+            record.write(location.geohash);
+            record.write(location.max_geohash_length);
+            det->save(record);
+            records.emplace_back(stream.str());
         }
     }
-    // --- push detector log messages at regular interval
 
-    return 0;
+    {
+        std::ofstream file { temporary, std::ios::binary | std::ios::trunc };
+        if (!file.is_open()) {
+            log::warning() << "Could not open state file '" << temporary << "' for writing.";
+            return;
+        }
+        binary_writer out { file };
+        out.write(s_snapshot_magic);
+        out.write(s_snapshot_version);
+        out.write(to_nanoseconds(std::chrono::system_clock::now()));
+        out.write(static_cast<std::uint64_t>(records.size()));
+        for (const auto& record : records) {
+            out.write(record);
+        }
+        if (!out.good()) {
+            log::warning() << "Could not write state file '" << temporary << "'.";
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        log::warning() << "Could not replace state file '" << path << "': " << error.message();
+    }
+}
+
+void station::restore()
+{
+    m_restored = true;
+    std::scoped_lock<std::mutex> lock { m_mutex };
+
+    const std::string& path { config::singleton()->files.state };
+    if (path.empty() || !std::filesystem::exists(path)) {
+        return;
+    }
+    std::ifstream file { path, std::ios::binary };
+    if (!file.is_open()) {
+        log::warning() << "Could not open state file '" << path << "' for reading.";
+        return;
+    }
+    binary_reader in { file };
+
+    std::uint32_t magic {};
+    std::uint16_t version {};
+    std::int64_t written {};
+    std::uint64_t n {};
+    if (!in.read(magic) || !in.read(version) || !in.read(written) || !in.read(n) || (magic != s_snapshot_magic) || (version != s_snapshot_version)) {
+        log::warning() << "Ignoring invalid state file '" << path << "'.";
+        return;
+    }
+
+    const auto now { std::chrono::system_clock::now() };
+    if ((now - from_nanoseconds(written)) > detector_table::s_quit_interval) {
+        log::info() << "Ignoring outdated state file '" << path << "'.";
+        return;
+    }
+
+    std::size_t restored { 0 };
+    std::string data {};
+    for (std::uint64_t i { 0 }; (i < n) && in.read(data); i++) {
+        std::istringstream stream { data };
+        binary_reader record { stream };
+
+        std::uint64_t hash {};
+        std::int64_t last_log {};
+        if (!record.read(hash) || !record.read(last_log)) {
+            continue;
+        }
+        if (((now - from_nanoseconds(last_log)) > detector_table::s_quit_interval) || (m_detectors.find(hash) != m_detectors.end())) {
+            continue;
+        }
+
+        detector_info_t<location_t> info {};
+        info.hash = hash;
+        auto& location { info.item<location_t>() };
+        if (!record.read(info.userinfo.username) || !record.read(info.userinfo.station_id)
+            || !record.read(location.lat) || !record.read(location.lon) || !record.read(location.h)
+            || !record.read(location.v_acc) || !record.read(location.h_acc) || !record.read(location.dop)
+            || !record.read(location.geohash) || !record.read(location.max_geohash_length)) {
+            continue;
+        }
+
+        auto det { std::make_unique<detector_station>(info, m_table, *this) };
+        if (!det->restore(record, from_nanoseconds(last_log))) {
+            static_cast<void>(m_table.erase(det->row()));
+            continue;
+        }
+        m_detectors.emplace(hash, std::move(det));
+        m_detectors.at(hash)->enable();
+        schedule(hash);
+        restored++;
+    }
+    log::info() << "Restored " << restored << " detector stations from '" << path << "'.";
+}
+
+void station::schedule(std::size_t hash)
+{
+    const auto now { std::chrono::system_clock::now() };
+    const std::uint64_t generation { m_next_generation++ };
+    m_generations[hash] = generation;
+
+    auto& det { m_detectors.at(hash) };
+
+    m_schedule.schedule(m_table.check_log(det->row(), now), maintenance { maintenance::task::log_interval, hash, generation });
+    m_schedule.schedule(det->step(now), maintenance { maintenance::task::rate, hash, generation });
+    m_schedule.schedule(now + std::chrono::duration_cast<std::chrono::system_clock::duration>(config::singleton()->interval.detectorsummary), maintenance { maintenance::task::summary, hash, generation });
+}
+
+void station::maintain(const std::chrono::system_clock::time_point& now, maintenance task)
+{
+    const auto generation { m_generations.find(task.hash) };
+    if ((generation == m_generations.end()) || (generation->second != task.generation)) {
+        return;
+    }
+    auto& det { m_detectors.at(task.hash) };
+
+    switch (task.type) {
+    case maintenance::task::log_interval: {
+        const auto next { m_table.check_log(det->row(), now) };
+        if (next != std::chrono::system_clock::time_point::max()) {
+            m_schedule.schedule(next, task);
+        }
+        break;
+    }
+    case maintenance::task::rate:
+        m_schedule.schedule(det->step(now), task);
+        break;
+    case maintenance::task::summary:
+        source::base<detector_summary_t>::put(det->current_log_data());
+        m_schedule.schedule(now + std::chrono::duration_cast<std::chrono::system_clock::duration>(config::singleton()->interval.detectorsummary), task);
+        break;
+    }
 }
 
 void station::on_detector_status(std::size_t hash, detector_status::status status, detector_status::reason reason)
@@ -116,6 +328,7 @@ void station::on_detector_status(std::size_t hash, detector_status::status statu
 auto station::get_stations() const -> std::vector<std::pair<userinfo_t, location_t>>
 {
     std::vector<std::pair<userinfo_t, location_t>> stations {};
+    std::scoped_lock<std::mutex> lock { m_mutex };
     for (const auto& [hash, stat] : m_detectors) {
         stations.emplace_back(std::make_pair(stat->user_info(), stat->location()));
     }
@@ -124,6 +337,7 @@ auto station::get_stations() const -> std::vector<std::pair<userinfo_t, location
 
 auto station::get_station(std::size_t hash) const -> std::pair<userinfo_t, location_t>
 {
+    std::scoped_lock<std::mutex> lock { m_mutex };
     const auto it { m_detectors.find(hash) };
     if (it == m_detectors.end()) {
         return {};
@@ -1,6 +1,7 @@
 #include "supervision/timebase.h"
 
 #include "messages/event.h"
+#include "supervision/state.h"
 
 #include "utility/log.h"
 
@@ -8,39 +9,105 @@
 
 namespace muonpi::supervision {
 
-timebase::timebase(sink::base<event_t>& event_sink, sink::base<timebase_t>& timebase_sink)
+timebase::timebase(sink::base<event_t>& event_sink, sink::base<timebase_t>& timebase_sink, state& supervisor, double percentile)
     : pipeline::base<event_t> { event_sink }
     , pipeline::base<timebase_t> { timebase_sink }
+    , m_supervisor { supervisor }
+    , m_percentile { std::clamp(percentile, 0.0, 1.0) }
+    , m_delay { m_percentile }
 {
 }
 
 void timebase::get(event_t event)
 {
-    if (event.data.start < m_start) {
+    std::unique_lock<std::mutex> lock { m_mutex };
+    if (m_percentile > 0.0) {
+        using namespace std::chrono;
+        const auto now { system_clock::now() };
+        const double delay { static_cast<double>(duration_cast<nanoseconds>(now.time_since_epoch()).count() - event.data.start) * 1e-6 };
+
+        station_t& station { m_stations[event.data.hash] };
+        station.median.add(delay);
+        station.last = now;
+
+        m_median.add(delay);
+        if (m_excluded.count(event.data.hash) == 0) {
+            m_delay.add(delay);
+        }
+    } else if (event.data.start < m_start) {
         m_start = event.data.start;
     } else if (event.data.start > m_end) {
         m_end = event.data.start;
     }
+    lock.unlock();
+
     pipeline::base<event_t>::put(std::move(event));
 }
 
 void timebase::get(timebase_t tb)
 {
-    if ((std::chrono::system_clock::now() - m_sample_start) < s_sample_time) {
+    // the delay percentile already contains the lag of all detectors which are not excluded
+    if (m_percentile > 0.0) {
+        tb.factor = 1.0;
+    }
+
+    {
+        std::scoped_lock<std::mutex> lock { m_mutex };
+        const auto now { std::chrono::system_clock::now() };
+        if ((now - m_sample_start) >= s_sample_time) {
+            m_sample_start = now;
+            if (m_percentile > 0.0) {
+                update_delay(now);
+            } else {
+                m_current = std::clamp(std::chrono::nanoseconds { m_end - m_start }, s_minimum, s_maximum);
+                m_start = std::numeric_limits<std::int_fast64_t>::max();
+                m_end = std::numeric_limits<std::int_fast64_t>::min();
+            }
+        }
         tb.base = m_current;
-        pipeline::base<timebase_t>::put(tb);
-        return;
     }
 
-    m_sample_start = std::chrono::system_clock::now();
+    pipeline::base<timebase_t>::put(tb);
+}
+
+void timebase::update_delay(std::chrono::system_clock::time_point now)
+{
+    using namespace std::chrono;
 
-    m_current = std::clamp(std::chrono::nanoseconds { m_end - m_start }, s_minimum, s_maximum);
+    if (m_delay.n() >= s_minimum_samples) {
+        m_current = std::clamp(duration_cast<system_clock::duration>(duration<double, std::milli> { m_delay.value() }), s_minimum_delay, s_maximum);
+    }
+    m_supervisor.delay_status(m_median.value(), m_delay.value(), m_excluded.size());
 
-    tb.base = m_current;
+    if ((now - m_period_start) < s_period) {
+        return;
+    }
+    m_period_start = now;
 
-    pipeline::base<timebase_t>::put(tb);
+    // +++ Determine the detectors which lag far behind the rest of the cluster
+    // Assumes the clocks are synchronised, so the delays are positive.
+    const double median { m_median.value() };
+    m_excluded.clear();
+    for (auto it { m_stations.begin() }; it != m_stations.end();) {
+        station_t& station { it->second };
+        if ((now - station.last) > s_period) {
+            it = m_stations.erase(it);
+            continue;
+        }
+        if ((station.median.n() >= s_minimum_station_samples) && (station.median.value() > (median * s_outlier_factor))) {
+            m_excluded.emplace(it->first);
+        }
+        station.median.reset();
+        ++it;
+    }
+    // --- Determine the detectors which lag far behind the rest of the cluster
+
+    if (!m_excluded.empty()) {
+        log::info() << "Excluding " << m_excluded.size() << " lagging detectors from the timebase.";
+    }
 
-    m_start = std::numeric_limits<std::int_fast64_t>::max();
-    m_end = std::numeric_limits<std::int_fast64_t>::min();
+    m_median.reset();
+    m_delay.reset();
 }
+
 } // namespace muonpi::supervision
@@ -51,7 +51,14 @@ auto config::setup(int argc, const char* argv[]) -> bool
             ("ldap_password", po::value<std::string>(), "LDAP Bind Password")
             ("ldap_host", po::value<std::string>(), "LDAP Hostname")
 
+            ("state_file", po::value<std::string>()->default_value(files.state), "File in which the state of the detector stations is kept between restarts")
+
+            ("coincidence_engine", po::value<std::string>()->default_value("constructor"), "Engine which combines events into coincidences. Either constructor or sweep.")
+            ("coincidence_threads", po::value<int>()->default_value(1), "Number of threads used to match coincidences.")
+            ("coincidence_criterion", po::value<std::string>()->default_value("simple"), "Criterion to decide whether two events are coincident. Either simple or geometric.")
+            ("timebase_percentile", po::value<double>()->default_value(99.0), "Percentile of the delay between the start of an event and its arrival to use as timeout. In percent. 0 uses the spread of the event times instead.")
             ("histogram", po::value<std::string>()->default_value("data"), "Track and store histograms. The parameter is the save directory")
+            ("histogram_max_distance", po::value<double>()->default_value(0.0), "Only keep histograms for station pairs closer than this distance. In km. 0 keeps histograms for all pairs.")
             ("histogram_sample_time", po::value<int>()->default_value(std::chrono::duration_cast<std::chrono::hours>(interval.histogram_sample_time).count()), "histogram sample time to use. In hours.")
             ("geohash_length", po::value<int>()->default_value(meta.max_geohash_length), "Geohash length to use")
             ("clusterlog_interval", po::value<int>()->default_value(std::chrono::duration_cast<std::chrono::minutes>(interval.clusterlog).count()), "Interval in which to send the cluster log. In minutes.")
@@ -116,6 +123,8 @@ auto config::setup(int argc, const char* argv[]) -> bool
 
     check_option("geohash_length", meta.max_geohash_length);
 
+    check_option("state_file", files.state);
+
     return true;
 }
 
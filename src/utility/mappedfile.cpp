@@ -0,0 +1,202 @@
+#include "utility/mappedfile.h"
+
+#include "utility/log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace muonpi {
+
+mapped_file::mapped_file(std::string path, std::uint32_t magic)
+    : m_path { std::move(path) }
+{
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd < 0) {
+        log::warning() << "Could not open checkpoint file '" << m_path << "': " << std::strerror(errno);
+        return;
+    }
+    struct stat status { };
+    if (fstat(m_fd, &status) != 0) {
+        log::warning() << "Could not stat checkpoint file '" << m_path << "': " << std::strerror(errno);
+        unmap();
+        return;
+    }
+    const std::size_t existing { static_cast<std::size_t>(status.st_size) };
+    const bool initialise { existing < sizeof(header_t) };
+    if (initialise && (ftruncate(m_fd, s_initial_size) != 0)) {
+        log::warning() << "Could not size checkpoint file '" << m_path << "': " << std::strerror(errno);
+        unmap();
+        return;
+    }
+    if (!map(initialise ? s_initial_size : existing)) {
+        return;
+    }
+
+    const header_t current { header() };
+    bool valid { !initialise && (current.magic == magic) && (current.format == s_format) && (current.active < current.regions.size()) };
+    for (const auto& region : current.regions) {
+        valid = valid && (region.offset >= sizeof(header_t)) && (region.offset <= m_size) && (region.used <= (m_size - region.offset));
+    }
+    if (!valid) {
+        if (!initialise) {
+            log::warning() << "Reinitialising invalid checkpoint file '" << m_path << "'.";
+        }
+        const region_t empty { 0, sizeof(header_t), 0 };
+        write_header(header_t { magic, s_format, 0, 0, { empty, empty } });
+    }
+}
+
+mapped_file::~mapped_file()
+{
+    unmap();
+}
+
+auto mapped_file::is_open() const -> bool
+{
+    return m_data != nullptr;
+}
+
+auto mapped_file::epoch() const -> std::int64_t
+{
+    if (m_data == nullptr) {
+        return 0;
+    }
+    const header_t current { header() };
+    return current.regions[current.active].epoch;
+}
+
+auto mapped_file::content() const -> std::string_view
+{
+    if (m_data == nullptr) {
+        return {};
+    }
+    const header_t current { header() };
+    const region_t& region { current.regions[current.active] };
+    return std::string_view { m_data + region.offset, static_cast<std::size_t>(region.used) };
+}
+
+auto mapped_file::append(std::string_view data) -> bool
+{
+    if (m_data == nullptr) {
+        return false;
+    }
+    const header_t current { header() };
+    region_t region { current.regions[current.active] };
+    if (!reserve(region.offset + region.used + data.size())) {
+        return false;
+    }
+    std::memcpy(m_data + region.offset + region.used, data.data(), data.size());
+    region.used += data.size();
+    write_region(current.active, region);
+    msync(m_data, m_size, MS_ASYNC);
+    return true;
+}
+
+auto mapped_file::replace(std::int64_t epoch, std::string_view data) -> bool
+{
+    if (m_data == nullptr) {
+        return false;
+    }
+    const header_t current { header() };
+    const region_t& active { current.regions[current.active] };
+
+    // the new content goes in front of the active content if it fits there, otherwise behind it
+    region_t region { epoch, sizeof(header_t), data.size() };
+    if ((active.used > 0) && ((region.offset + data.size()) > active.offset)) {
+        constexpr std::uint64_t alignment { 8 };
+        region.offset = (active.offset + active.used + alignment - 1) / alignment * alignment;
+    }
+    if (!reserve(region.offset + region.used)) {
+        return false;
+    }
+    std::memcpy(m_data + region.offset, data.data(), data.size());
+
+    const std::uint32_t inactive { 1 - current.active };
+    write_region(inactive, region);
+    activate(inactive);
+    msync(m_data, m_size, MS_ASYNC);
+    return true;
+}
+
+void mapped_file::reset(std::int64_t epoch)
+{
+    static_cast<void>(replace(epoch, {}));
+}
+
+auto mapped_file::map(std::size_t size) -> bool
+{
+    void* data { mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0) };
+    if (data == MAP_FAILED) {
+        log::warning() << "Could not map checkpoint file '" << m_path << "': " << std::strerror(errno);
+        unmap();
+        return false;
+    }
+    m_data = static_cast<char*>(data);
+    m_size = size;
+    return true;
+}
+
+void mapped_file::unmap()
+{
+    if (m_data != nullptr) {
+        msync(m_data, m_size, MS_ASYNC);
+        munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+auto mapped_file::reserve(std::size_t size) -> bool
+{
+    if (m_data == nullptr) {
+        return false;
+    }
+    if (size <= m_size) {
+        return true;
+    }
+    const std::size_t new_size { std::max(size, m_size * 2) };
+    munmap(m_data, m_size);
+    m_data = nullptr;
+    if (ftruncate(m_fd, static_cast<off_t>(new_size)) != 0) {
+        log::warning() << "Could not grow checkpoint file '" << m_path << "': " << std::strerror(errno);
+        static_cast<void>(map(m_size));
+        return false;
+    }
+    return map(new_size);
+}
+
+auto mapped_file::header() const -> header_t
+{
+    header_t current {};
+    std::memcpy(&current, m_data, sizeof(header_t));
+    return current;
+}
+
+void mapped_file::write_header(const header_t& header)
+{
+    std::memcpy(m_data, &header, sizeof(header_t));
+}
+
+void mapped_file::write_region(std::uint32_t index, const region_t& region)
+{
+    std::memcpy(m_data + offsetof(header_t, regions) + index * sizeof(region_t), &region, sizeof(region_t));
+}
+
+void mapped_file::activate(std::uint32_t index)
+{
+    // a single aligned store, so the switch is either completely visible or not at all
+    std::memcpy(m_data + offsetof(header_t, active), &index, sizeof(index));
+}
+
+} // namespace muonpi
@@ -0,0 +1,98 @@
+#include "utility/spatialgrid.h"
+
+#include "utility/units.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace muonpi {
+
+// slightly below the smallest radius of curvature of the WGS84 ellipsoid, so a cell is never shorter than the search distance
+constexpr static double s_earth_radius { 6300.0 * units::kilometer };
+
+spatial_grid::spatial_grid(double distance)
+    : m_cell_size { std::clamp(distance / s_earth_radius / units::degree, 1e-6, 180.0) }
+    , m_rows { static_cast<std::int64_t>(std::ceil(180.0 / m_cell_size)) }
+    , m_columns { static_cast<std::int64_t>(std::ceil(360.0 / m_cell_size)) }
+{
+}
+
+void spatial_grid::insert(std::size_t id, double lat, double lon)
+{
+    m_cells[key(row(lat), column(lon))].emplace_back(id);
+}
+
+void spatial_grid::clear()
+{
+    m_cells.clear();
+}
+
+auto spatial_grid::neighbours(double lat, double lon) const -> std::vector<std::size_t>
+{
+    std::vector<std::size_t> result {};
+    for (const std::int64_t neighbour : neighbour_cells(cell(lat, lon))) {
+        const auto it { m_cells.find(neighbour) };
+        if (it != m_cells.end()) {
+            result.insert(result.end(), it->second.begin(), it->second.end());
+        }
+    }
+    return result;
+}
+
+auto spatial_grid::cell(double lat, double lon) const -> std::int64_t
+{
+    return key(row(lat), column(lon));
+}
+
+auto spatial_grid::neighbour_cells(std::int64_t cell) const -> std::vector<std::int64_t>
+{
+    const std::int64_t r { cell / m_columns };
+    const std::int64_t c { cell % m_columns };
+
+    // A cell is one search distance high, but its width in meter shrinks with the cosine of the latitude.
+    // The number of columns to search is chosen for the latitude closest to the pole within the searched rows.
+    const double lower { -90.0 + static_cast<double>(r - 1) * m_cell_size };
+    const double upper { -90.0 + static_cast<double>(r + 2) * m_cell_size };
+    const double pole_lat { std::min(90.0, std::max(std::abs(lower), std::abs(upper))) };
+    const double shrink { std::cos(pole_lat * units::degree) };
+    std::int64_t width { m_columns };
+    if (shrink > (1.0 / static_cast<double>(m_columns))) {
+        width = static_cast<std::int64_t>(std::ceil(1.0 / shrink));
+    }
+
+    std::vector<std::int64_t> result {};
+    for (std::int64_t dr { -1 }; dr <= 1; dr++) {
+        const std::int64_t cell_row { r + dr };
+        if ((cell_row < 0) || (cell_row >= m_rows)) {
+            continue;
+        }
+        if ((2 * width + 1) >= m_columns) {
+            for (std::int64_t cell_column { 0 }; cell_column < m_columns; cell_column++) {
+                result.emplace_back(key(cell_row, cell_column));
+            }
+            continue;
+        }
+        for (std::int64_t dc { -width }; dc <= width; dc++) {
+            result.emplace_back(key(cell_row, (c + dc + m_columns) % m_columns));
+        }
+    }
+    return result;
+}
+
+auto spatial_grid::row(double lat) const -> std::int64_t
+{
+    return std::clamp<std::int64_t>(static_cast<std::int64_t>(std::floor((lat + 90.0) / m_cell_size)), 0, m_rows - 1);
+}
+
+auto spatial_grid::column(double lon) const -> std::int64_t
+{
+    const std::int64_t c { static_cast<std::int64_t>(std::floor((lon + 180.0) / m_cell_size)) };
+    return ((c % m_columns) + m_columns) % m_columns;
+}
+
+auto spatial_grid::key(std::int64_t row, std::int64_t column) const -> std::int64_t
+{
+    return row * m_columns + column;
+}
+
+} // namespace muonpi
@@ -0,0 +1,80 @@
+#include "utility/workerpool.h"
+
+#include <algorithm>
+
+namespace muonpi {
+
+worker_pool::worker_pool(std::size_t threads)
+{
+    for (std::size_t i { 1 }; i < std::max<std::size_t>(threads, 1); i++) {
+        m_threads.emplace_back(&worker_pool::work, this);
+    }
+}
+
+worker_pool::~worker_pool()
+{
+    {
+        std::scoped_lock<std::mutex> lock { m_mutex };
+        m_quit = true;
+    }
+    m_start.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void worker_pool::run(std::size_t count, const std::function<void(std::size_t)>& task)
+{
+    {
+        std::scoped_lock<std::mutex> lock { m_mutex };
+        m_task = &task;
+        m_count = count;
+        m_next = 0;
+        m_active = m_threads.size();
+        m_generation++;
+    }
+    m_start.notify_all();
+
+    drain();
+
+    std::unique_lock<std::mutex> lock { m_mutex };
+    m_done.wait(lock, [this] { return m_active == 0; });
+    m_task = nullptr;
+}
+
+auto worker_pool::size() const -> std::size_t
+{
+    return m_threads.size() + 1;
+}
+
+void worker_pool::work()
+{
+    std::size_t generation { 0 };
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            m_start.wait(lock, [&] { return m_quit || (m_generation != generation); });
+            if (m_quit) {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        drain();
+
+        std::scoped_lock<std::mutex> lock { m_mutex };
+        m_active--;
+        if (m_active == 0) {
+            m_done.notify_all();
+        }
+    }
+}
+
+void worker_pool::drain()
+{
+    for (std::size_t i { m_next++ }; i < m_count; i = m_next++) {
+        (*m_task)(i);
+    }
+}
+
+} // namespace muonpi
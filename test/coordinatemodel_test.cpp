@@ -0,0 +1,152 @@
+#include "utility/coordinatemodel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Checks the batched coordinate transformations against a straightforward long double reference of the textbook formulas,
+ * and against the scalar functions used everywhere else.
+ * The bounds are about ten times the deviations observed with gcc on x86_64.
+ * There the batched and the scalar calculations agree exactly, their bound only leaves room for a different rounding of vectorised code.
+ */
+
+using namespace muonpi;
+
+namespace {
+
+using transformation = coordinate::transformation<double, coordinate::WGS84>;
+
+constexpr double s_distance_bound { 1e-7 }; //< in meter, between the reference and any distance calculation
+constexpr double s_batch_bound { 1e-8 }; //< in meter, between the batched and the scalar calculation of the same distance
+constexpr double s_angle_bound { 1e-14 }; //< in radian, for the round trip to ecef and back
+constexpr double s_height_bound { 5e-6 }; //< in meter, for the round trip to ecef and back
+
+constexpr long double s_pi { 3.141592653589793238462643383279502884L };
+
+struct reference_ecef {
+    long double x {};
+    long double y {};
+    long double z {};
+};
+
+[[nodiscard]] auto reference_to_ecef(const coordinate::geodetic<double>& coords) -> reference_ecef
+{
+    const long double a { coordinate::WGS84<double>::a };
+    const long double b { coordinate::WGS84<double>::b };
+    const long double e_squared { coordinate::WGS84<double>::e_squared };
+    const long double lat { coords.lat };
+    const long double lon { coords.lon };
+    const long double N { a / std::sqrt(1.0L - e_squared * std::pow(std::sin(lat), 2.0L)) };
+    return {
+        (N + coords.h) * std::cos(lat) * std::cos(lon),
+        (N + coords.h) * std::cos(lat) * std::sin(lon),
+        (N * std::pow(b, 2.0L) / std::pow(a, 2.0L) + coords.h) * std::sin(lat)
+    };
+}
+
+[[nodiscard]] auto reference_distance(const coordinate::geodetic<double>& first, const coordinate::geodetic<double>& second) -> double
+{
+    const reference_ecef lhs { reference_to_ecef(first) };
+    const reference_ecef rhs { reference_to_ecef(second) };
+    return static_cast<double>(std::sqrt(std::pow(lhs.x - rhs.x, 2.0L) + std::pow(lhs.y - rhs.y, 2.0L) + std::pow(lhs.z - rhs.z, 2.0L)));
+}
+
+struct result_t {
+    double worst {};
+    bool passed { true };
+
+    void check(double deviation, double bound)
+    {
+        worst = std::max(worst, deviation);
+        passed = passed && (deviation <= bound);
+    }
+};
+
+void report(const std::string& name, const result_t& result, double bound)
+{
+    std::cout << (result.passed ? "passed " : "FAILED ") << name << ": worst deviation " << result.worst << ", bound " << bound << '\n';
+}
+
+}
+
+auto main() -> int
+{
+    std::mt19937_64 rng { 42 };
+    std::uniform_real_distribution<double> unit { 0.0, 1.0 };
+    const auto random_point { [&] {
+        return coordinate::geodetic<double> { static_cast<double>((unit(rng) - 0.5) * s_pi), static_cast<double>((2.0 * unit(rng) - 1.0) * s_pi), unit(rng) * 5000.0 - 500.0 };
+    } };
+
+    // +++ scalar distance and round trip against the reference, for pairs all over the globe and close pairs
+    result_t scalar {};
+    result_t angle {};
+    result_t height {};
+    for (std::size_t i { 0 }; i < 200000; i++) {
+        const coordinate::geodetic<double> first { random_point() };
+        coordinate::geodetic<double> second { random_point() };
+        if ((i % 2) == 0) {
+            second.lat = std::clamp(first.lat + (unit(rng) - 0.5) * 0.02, -0.5 * static_cast<double>(s_pi), 0.5 * static_cast<double>(s_pi));
+            second.lon = first.lon + (unit(rng) - 0.5) * 0.02;
+        }
+        scalar.check(std::abs(transformation::straight_distance(first, second) - reference_distance(first, second)), s_distance_bound);
+
+        const coordinate::geodetic<double> back { transformation::to_geodetic(transformation::to_ecef(first)) };
+        angle.check(std::max(std::abs(back.lat - first.lat), std::abs(std::remainder(back.lon - first.lon, 2.0 * static_cast<double>(s_pi)))), s_angle_bound);
+        height.check(std::abs(back.h - first.h), s_height_bound);
+    }
+    // --- scalar distance and round trip against the reference
+
+    // +++ batched calculations against the scalar ones, for a network of stations in central Europe
+    constexpr std::size_t n { 2000 };
+    std::vector<double> lat(n);
+    std::vector<double> lon(n);
+    std::vector<double> h(n);
+    std::vector<coordinate::geodetic<double>> points(n);
+    for (std::size_t i { 0 }; i < n; i++) {
+        lat[i] = (45.0 + unit(rng) * 10.0) * static_cast<double>(s_pi) / 180.0;
+        lon[i] = (unit(rng) * 20.0) * static_cast<double>(s_pi) / 180.0;
+        h[i] = unit(rng) * 1000.0;
+        points[i] = { lat[i], lon[i], h[i] };
+    }
+
+    const coordinate::ecef_array<double> positions { transformation::to_ecef(lat.data(), lon.data(), h.data(), n) };
+    result_t batch_ecef {};
+    for (std::size_t i { 0 }; i < n; i++) {
+        const coordinate::ecef<double> single { transformation::to_ecef(points[i]) };
+        batch_ecef.check(std::max({ std::abs(positions.x[i] - single.x), std::abs(positions.y[i] - single.y), std::abs(positions.z[i] - single.z) }), s_batch_bound);
+    }
+
+    const std::vector<double> matrix { transformation::distance_matrix(positions) };
+    std::vector<double> row(n);
+    result_t batch_matrix {};
+    result_t batch_row {};
+    result_t batch_reference {};
+    for (std::size_t x { 1 }; x < n; x++) {
+        transformation::straight_distances(positions, x, 0, n, row.data());
+        for (std::size_t y { 0 }; y < x; y++) {
+            const double single { transformation::straight_distance(points[x], points[y]) };
+            batch_matrix.check(std::abs(matrix[(x * x - x) / 2 + y] - single), s_batch_bound);
+            batch_row.check(std::abs(row[y] - single), s_batch_bound);
+            if ((y % 37) == 0) {
+                batch_reference.check(std::abs(matrix[(x * x - x) / 2 + y] - reference_distance(points[x], points[y])), s_distance_bound);
+            }
+        }
+    }
+    // --- batched calculations against the scalar ones
+
+    report("straight_distance against reference [m]", scalar, s_distance_bound);
+    report("round trip latitude and longitude [rad]", angle, s_angle_bound);
+    report("round trip height [m]", height, s_height_bound);
+    report("batched to_ecef against scalar [m]", batch_ecef, s_batch_bound);
+    report("distance_matrix against scalar [m]", batch_matrix, s_batch_bound);
+    report("straight_distances against scalar [m]", batch_row, s_batch_bound);
+    report("distance_matrix against reference [m]", batch_reference, s_distance_bound);
+
+    const bool passed { scalar.passed && angle.passed && height.passed && batch_ecef.passed && batch_matrix.passed && batch_row.passed && batch_reference.passed };
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
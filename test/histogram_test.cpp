@@ -0,0 +1,137 @@
+#include "analysis/histogram.h"
+#include "analysis/sparsehistogram.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Checks the bin index of integral binnings against the exact integer quotient (value - lower) / width,
+ * for widths which are a power of two, odd widths using the fixed point reciprocal and ranges too wide for 32 bit.
+ * Both the scalar index and the batched kernels are checked, as well as the batched add of histogram and sparse_histogram
+ * against adding the same values one by one.
+ * The values cover the whole range of the type, and every bin edge with its neighbours.
+ */
+
+using namespace muonpi;
+
+namespace {
+
+constexpr std::size_t s_random_values { 200000 };
+
+struct result_t {
+    std::size_t checked {};
+    std::size_t failed {};
+
+    void check(bool correct)
+    {
+        checked++;
+        failed += correct ? 0 : 1;
+    }
+};
+
+void report(const std::string& name, const result_t& result)
+{
+    std::cout << ((result.failed == 0) ? "passed " : "FAILED ") << name << ": " << result.failed << " of " << result.checked << " wrong\n";
+}
+
+template <std::size_t N, typename T>
+[[nodiscard]] auto reference(T value, T lower, T width) -> std::size_t
+{
+    if (value < lower) {
+        return N;
+    }
+    // the difference is exact modulo 2^64, and it is not negative
+    const auto offset { static_cast<std::uint64_t>(value) - static_cast<std::uint64_t>(lower) };
+    const auto bin { offset / static_cast<std::uint64_t>(width) };
+    return (bin < N) ? static_cast<std::size_t>(bin) : N;
+}
+
+template <std::size_t N, typename T>
+[[nodiscard]] auto values(T lower, T width, std::mt19937_64& rng) -> std::vector<T>
+{
+    std::vector<T> result {};
+    for (std::size_t i { 0 }; i <= N; i++) {
+        const auto edge { static_cast<T>(lower + width * static_cast<T>(i)) };
+        result.emplace_back(edge);
+        result.emplace_back(static_cast<T>(edge - 1));
+        result.emplace_back(static_cast<T>(edge + 1));
+    }
+    result.emplace_back(std::numeric_limits<T>::min());
+    result.emplace_back(std::numeric_limits<T>::max());
+
+    const auto upper { static_cast<T>(lower + width * static_cast<T>(N)) };
+    std::uniform_int_distribution<T> inside { lower, upper };
+    std::uniform_int_distribution<T> anywhere { std::numeric_limits<T>::min(), std::numeric_limits<T>::max() };
+    for (std::size_t i { 0 }; i < s_random_values; i++) {
+        result.emplace_back(((i % 4) == 0) ? anywhere(rng) : inside(rng));
+    }
+    return result;
+}
+
+template <std::size_t N, typename T>
+[[nodiscard]] auto check(const std::string& name, T lower, T width, std::mt19937_64& rng) -> bool
+{
+    const std::vector<T> input { values<N, T>(lower, width, rng) };
+    const binning<N, T> bins { lower, width };
+
+    result_t scalar {};
+    result_t batched {};
+    std::vector<std::uint32_t> indices(input.size());
+    bins.index(input.data(), input.size(), indices.data());
+    for (std::size_t i { 0 }; i < input.size(); i++) {
+        const std::size_t expected { reference<N, T>(input[i], lower, width) };
+        scalar.check(bins.index(input[i]) == expected);
+        batched.check(indices[i] == expected);
+    }
+
+    const auto upper { static_cast<T>(lower + width * static_cast<T>(N)) };
+    histogram<N, T, std::uint32_t> single { lower, upper };
+    histogram<N, T, std::uint32_t> batch { lower, upper };
+    sparse_histogram<N, T, std::uint32_t> sparse_single { lower, upper };
+    sparse_histogram<N, T, std::uint32_t> sparse_batch { lower, upper };
+    std::size_t inside { 0 };
+    for (const T value : input) {
+        inside += (single.add(value) < N) ? 1 : 0;
+        (void)sparse_single.add(value);
+    }
+    result_t histograms {};
+    histograms.check(batch.add(input.data(), input.size()) == inside);
+    histograms.check(sparse_batch.add(input.data(), input.size()) == inside);
+    histograms.check(batch.bins() == single.bins());
+    const auto sparse_bins { sparse_batch.qualified_bins() };
+    const auto sparse_single_bins { sparse_single.qualified_bins() };
+    for (std::size_t i { 0 }; i < N; i++) {
+        histograms.check(sparse_bins[i].count == single.bins()[i]);
+        histograms.check(sparse_single_bins[i].count == single.bins()[i]);
+    }
+
+    report(name + " scalar index", scalar);
+    report(name + " batched index", batched);
+    report(name + " batched add", histograms);
+    return (scalar.failed == 0) && (batched.failed == 0) && (histograms.failed == 0);
+}
+
+}
+
+auto main() -> int
+{
+    std::mt19937_64 rng { 42 };
+
+    bool passed { true };
+    passed = check<1000, std::int32_t>("int32 width 1", -500, 1, rng) && passed;
+    passed = check<1000, std::int32_t>("int32 width 64", -20000, 64, rng) && passed;
+    passed = check<1000, std::int32_t>("int32 width 3", 7, 3, rng) && passed;
+    passed = check<1000, std::int32_t>("int32 width 1000", -500000, 1000, rng) && passed;
+    // the range comes close to 2^32, where the error of the reciprocal is largest
+    passed = check<65000, std::uint32_t>("uint32 width 65537", 0, 65537, rng) && passed;
+    passed = check<1000, std::int64_t>("int64 width 1024", -1000000, 1024, rng) && passed;
+    passed = check<1000, std::int64_t>("int64 width 999", 123456789, 999, rng) && passed;
+    // ranges beyond 32 bit, which fall back to the division
+    passed = check<1000, std::int64_t>("int64 wide width 2^33", -(std::int64_t { 1 } << 40), std::int64_t { 1 } << 33, rng) && passed;
+    passed = check<2000, std::int64_t>("int64 wide width 1000000007", -1000000000000, 1000000007, rng) && passed;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,235 @@
+#include "analysis/coincidence.h"
+#include "analysis/coincidencefilter.h"
+#include "analysis/simplecoincidence.h"
+#include "analysis/sweepfilter.h"
+#include "messages/clusterlog.h"
+#include "messages/event.h"
+#include "sink/base.h"
+#include "supervision/state.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Compares sweep_filter with coincidence_filter on simulated traffic of a dense network.
+ *
+ * Both engines send off every event exactly once.
+ * A merged coincidence is compared against new events by all of its constituents, so the result of both engines depends on the order of the events.
+ * sweep_filter matches in the order of the timestamps, whatever the arrival order. It has to find exactly the same clusters
+ * as coincidence_filter fed with the events sorted by their timestamps, with one thread as well as with several.
+ * coincidence_filter matches in the order of arrival, which differs by the random latency of every event.
+ * With several threads it matches the events in batches, and has to find exactly the same clusters as with one.
+ * The share of clusters identical to the ones in arrival order is only printed for information, it is not a measure of correctness.
+ * The simple criterion only compares the first and last constituents and hardly depends on the order,
+ * the geometric criterion compares all pairs of constituents and differs in about one in ten clusters at a high shower rate.
+ */
+
+using namespace muonpi;
+
+namespace {
+
+using cluster_t = std::vector<std::pair<std::uint64_t, std::int64_t>>; //< station hash and start of every constituent, sorted
+
+constexpr std::size_t s_stations { 300 };
+constexpr double s_seconds { 300.0 };
+constexpr double s_noise_rate { 0.1 }; //< uncorrelated events per station and second
+constexpr double s_mean_latency { 0.2 }; //< mean delay of the arrival in seconds
+constexpr std::int64_t s_epoch { 1600000000000000000 };
+
+class collector : public sink::base<event_t> {
+public:
+    void get(event_t event) override
+    {
+        events.emplace_back(std::move(event));
+    }
+
+    std::vector<event_t> events {};
+};
+
+class discard : public sink::base<cluster_log_t> {
+public:
+    void get(cluster_log_t /*log*/) override
+    {
+    }
+};
+
+/**
+ * @brief Gives the test access to the processing steps of an engine, without its thread
+ */
+template <typename Engine>
+class driven : public Engine {
+public:
+    using Engine::process;
+
+    template <typename... Args>
+    explicit driven(Args&&... args)
+        : Engine { std::forward<Args>(args)... }
+    {
+        this->stop();
+        this->join();
+    }
+
+    void feed(event_t event)
+    {
+        (void)this->process(std::move(event));
+    }
+
+    void flush()
+    {
+        // the watermark never stays further behind the current time than the timeout, so it has passed all simulated events
+        (void)this->process();
+        (void)this->post_run();
+    }
+};
+
+[[nodiscard]] auto key(const event_t& event) -> cluster_t
+{
+    cluster_t result {};
+    for (const auto& data : constituents { event }) {
+        result.emplace_back(data.hash, data.start);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+[[nodiscard]] auto simulate(std::uint64_t seed, double shower_rate) -> std::vector<event_t>
+{
+    std::mt19937_64 rng { seed };
+    std::uniform_real_distribution<double> unit { 0.0, 1.0 };
+    std::exponential_distribution<double> latency { 1.0 / s_mean_latency };
+
+    std::vector<std::pair<std::int64_t, event_t>> arrivals {};
+    const auto emit { [&](std::uint64_t station, double time) {
+        event_t event {};
+        event.data.hash = station;
+        event.data.start = s_epoch + static_cast<std::int64_t>(time * 1e9);
+        event.data.end = event.data.start + 100;
+        event.data.location.lat = 50.0 + static_cast<double>(station % 20) * 0.01;
+        event.data.location.lon = 8.0 + static_cast<double>(station / 20) * 0.01;
+        arrivals.emplace_back(event.data.start + static_cast<std::int64_t>(latency(rng) * 1e9), std::move(event));
+    } };
+
+    for (std::uint64_t station { 0 }; station < s_stations; station++) {
+        std::exponential_distribution<double> interval { s_noise_rate };
+        for (double time { interval(rng) }; time < s_seconds; time += interval(rng)) {
+            emit(station, time);
+        }
+    }
+    std::exponential_distribution<double> interval { shower_rate };
+    for (double time { interval(rng) }; time < s_seconds; time += interval(rng)) {
+        // a shower hits two to five neighbouring stations within 20 us
+        const std::uint64_t centre { rng() % s_stations };
+        std::set<std::uint64_t> hit {};
+        for (std::uint64_t n { 2 + rng() % 4 }; n > 0; n--) {
+            const std::uint64_t station { (centre + rng() % 10) % s_stations };
+            if (hit.insert(station).second) {
+                emit(station, time + unit(rng) * 20e-6);
+            }
+        }
+    }
+
+    std::sort(arrivals.begin(), arrivals.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    std::vector<event_t> events {};
+    for (auto& [arrival, event] : arrivals) {
+        events.emplace_back(std::move(event));
+    }
+    return events;
+}
+
+[[nodiscard]] auto clusters(const collector& output) -> std::multiset<cluster_t>
+{
+    std::multiset<cluster_t> result {};
+    for (const auto& event : output.events) {
+        result.insert(key(event));
+    }
+    return result;
+}
+
+[[nodiscard]] auto conserved(const std::multiset<cluster_t>& output, const std::vector<event_t>& input) -> bool
+{
+    cluster_t all {};
+    for (const auto& cluster : output) {
+        all.insert(all.end(), cluster.begin(), cluster.end());
+    }
+    cluster_t expected {};
+    for (const auto& event : input) {
+        expected.emplace_back(event.data.hash, event.data.start);
+    }
+    std::sort(all.begin(), all.end());
+    std::sort(expected.begin(), expected.end());
+    return all == expected;
+}
+
+template <typename Engine, typename... Args>
+[[nodiscard]] auto run(const std::vector<event_t>& events, supervision::state& supervisor, Args&&... args) -> std::multiset<cluster_t>
+{
+    collector output {};
+    driven<Engine> engine { output, supervisor, std::forward<Args>(args)... };
+    for (const auto& event : events) {
+        engine.feed(event);
+    }
+    engine.flush();
+    return clusters(output);
+}
+
+template <typename Criterion>
+[[nodiscard]] auto compare(const std::vector<event_t>& arrivals, const std::string& name) -> bool
+{
+    discard cluster_sink {};
+    supervision::state supervisor { cluster_sink };
+
+    std::vector<event_t> ordered { arrivals };
+    std::sort(ordered.begin(), ordered.end(), [](const event_t& lhs, const event_t& rhs) {
+        return std::make_pair(lhs.data.start, lhs.data.hash) < std::make_pair(rhs.data.start, rhs.data.hash);
+    });
+
+    const std::multiset<cluster_t> arrival_order { run<coincidence_filter<Criterion>>(arrivals, supervisor) };
+    const std::multiset<cluster_t> batched { run<coincidence_filter<Criterion>>(arrivals, supervisor, std::size_t { 4 }) };
+    const std::multiset<cluster_t> time_order { run<coincidence_filter<Criterion>>(ordered, supervisor) };
+    const std::multiset<cluster_t> swept { run<sweep_filter<Criterion>>(arrivals, supervisor) };
+    const std::multiset<cluster_t> parallel { run<sweep_filter<Criterion>>(arrivals, supervisor, std::size_t { 4 }) };
+
+    std::size_t identical { 0 };
+    std::multiset<cluster_t> remaining { swept };
+    for (const auto& cluster : arrival_order) {
+        auto it { remaining.find(cluster) };
+        if (it != remaining.end()) {
+            remaining.erase(it);
+            identical++;
+        }
+    }
+    const double share { static_cast<double>(identical) / static_cast<double>(std::max(arrival_order.size(), swept.size())) };
+
+    const bool events_conserved { conserved(arrival_order, arrivals) && conserved(swept, arrivals) };
+    const bool equivalent { (swept == time_order) && (parallel == swept) && (batched == arrival_order) };
+    const bool passed { events_conserved && equivalent };
+    std::cout << name << ": " << swept.size() << " clusters swept, "
+              << (equivalent ? "identical to" : "DIFFERENT from") << " the ones in time order and batches identical to single events, "
+              << identical << " of " << arrival_order.size() << " identical to the ones in arrival order (" << share << "), events "
+              << (events_conserved ? "conserved" : "LOST OR DUPLICATED")
+              << (passed ? "" : " FAILED") << '\n';
+    return passed;
+}
+
+} // namespace
+
+auto main() -> int
+{
+    constexpr std::array<double, 2> shower_rates { 2.0, 50.0 }; //< showers per second
+
+    bool passed { true };
+    for (const double shower_rate : shower_rates) {
+        const std::vector<event_t> arrivals { simulate(42, shower_rate) };
+        std::cout << arrivals.size() << " events with " << shower_rate << " showers/s\n";
+        passed = compare<simple_coincidence>(arrivals, "simple") && passed;
+        passed = compare<coincidence>(arrivals, "geometric") && passed;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,120 @@
+#include "analysis/uppermatrix.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Grows an upper_matrix to a network of the given size (10000 stations by default) one station at a time, as the station coincidence does,
+ * and reports the total and the worst time of a single growth step.
+ * A flat triangle in one contiguous allocation is grown the same way as a reference.
+ * Before that the pair bookkeeping is verified against a random sequence of additions and removals.
+ */
+
+using namespace muonpi;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct timing_t {
+    double total {};
+    double worst {};
+};
+
+/**
+ * @brief The flat_triangle struct. Reference layout storing all pairs in one allocation.
+ */
+struct flat_triangle {
+    std::vector<std::uint32_t> elements {};
+    std::size_t columns { 0 };
+
+    auto increase() -> std::size_t
+    {
+        columns++;
+        elements.resize((columns * (columns - 1)) / 2);
+        return columns - 1;
+    }
+};
+
+[[nodiscard]] auto verify() -> bool
+{
+    upper_matrix<std::pair<int, int>> matrix { 0 };
+    std::vector<int> ids {};
+    std::mt19937 rng { 1 };
+    int next { 0 };
+    for (std::size_t step { 0 }; step < 1000; step++) {
+        if ((ids.size() < 3) || ((rng() % 3) != 0)) {
+            const auto x { matrix.increase() };
+            ids.emplace_back(next++);
+            for (std::size_t y { 0 }; y < x; y++) {
+                matrix.emplace(x, y, { ids[x], ids[y] });
+            }
+        } else {
+            const std::size_t index { rng() % ids.size() };
+            matrix.remove_index(index);
+            ids[index] = ids.back();
+            ids.pop_back();
+        }
+        for (std::size_t x { 1 }; x < ids.size(); x++) {
+            for (std::size_t y { 0 }; y < x; y++) {
+                const auto pair { matrix.at(x, y) };
+                const bool forward { (pair.first == ids[x]) && (pair.second == ids[y]) };
+                const bool backward { (pair.first == ids[y]) && (pair.second == ids[x]) };
+                if ((!forward && !backward) || (pair != matrix.at(y, x))) {
+                    std::cerr << "pair (" << x << ", " << y << ") is wrong after step " << step << '\n';
+                    return false;
+                }
+            }
+        }
+    }
+    std::size_t count { 0 };
+    matrix.for_each([&](std::pair<int, int>& /*pair*/) { count++; });
+    if (count != ((ids.size() * (ids.size() - 1)) / 2)) {
+        std::cerr << "for_each visited " << count << " pairs for " << ids.size() << " stations\n";
+        return false;
+    }
+    return true;
+}
+
+template <typename M>
+[[nodiscard]] auto grow(M& matrix, std::size_t stations) -> timing_t
+{
+    timing_t timing {};
+    const auto start { clock_type::now() };
+    for (std::size_t i { 0 }; i < stations; i++) {
+        const auto before { clock_type::now() };
+        matrix.increase();
+        timing.worst = std::max(timing.worst, std::chrono::duration<double, std::milli>(clock_type::now() - before).count());
+    }
+    timing.total = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    return timing;
+}
+
+}
+
+auto main(int argc, char* argv[]) -> int
+{
+    const std::size_t stations { (argc > 1) ? std::stoul(argv[1]) : 10000 };
+
+    if (!verify()) {
+        return EXIT_FAILURE;
+    }
+
+    {
+        upper_matrix<std::uint32_t> matrix { 0 };
+        const auto timing { grow(matrix, stations) };
+        std::cout << "upper_matrix: " << stations << " stations in " << timing.total << " ms, worst step " << timing.worst << " ms\n";
+    }
+    {
+        flat_triangle matrix {};
+        const auto timing { grow(matrix, stations) };
+        std::cout << "flat reference: " << stations << " stations in " << timing.total << " ms, worst step " << timing.worst << " ms\n";
+    }
+    return EXIT_SUCCESS;
+}